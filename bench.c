@@ -0,0 +1,460 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <time.h>
+
+#ifndef UGC_IMPLEMENTATION
+#define UGC_IMPLEMENTATION
+#endif
+
+#include "ugc.h"
+
+#define HIST_SUB_BITS 5
+#define HIST_NUM_BUCKETS ((64 - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
+// Objects are registered white and the root is rescanned at the end of the mark
+// phase, with too few steps per allocation, the mark phase would never end.
+#define STEPS_PER_ALLOC 4
+
+typedef struct bench_obj_s bench_obj_t;
+typedef struct bench_s bench_t;
+
+struct bench_obj_s
+{
+	ugc_header_t header;
+#if UGC_USE_LAYOUT
+	const ugc_layout_t* layout;
+#endif
+	size_t num_refs;
+	bench_obj_t* refs[];
+};
+
+struct bench_s
+{
+	ugc_t gc;
+
+	size_t num_roots;
+	bench_obj_t** roots;
+
+	uint64_t num_allocs;
+	uint64_t num_marked;
+	uint64_t num_swept;
+	uint64_t num_live;
+	uint64_t peak_live;
+
+	uint64_t num_steps;
+	uint64_t max_step;
+	uint64_t phase_time[3];
+	uint64_t histogram[HIST_NUM_BUCKETS];
+
+	uint64_t num_barriers;
+	uint64_t barrier_time;
+};
+
+struct workload_s
+{
+	const char* name;
+	void(*run)(bench_t* bench, unsigned int scale);
+};
+
+static uint64_t
+now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static unsigned int
+hist_index(uint64_t value)
+{
+	if(value < (1 << HIST_SUB_BITS)) { return (unsigned int)value; }
+
+	unsigned int msb = 63 - __builtin_clzll(value);
+	unsigned int group = msb - HIST_SUB_BITS + 1;
+	unsigned int sub = (value >> (msb - HIST_SUB_BITS)) & ((1 << HIST_SUB_BITS) - 1);
+	return (group << HIST_SUB_BITS) + sub;
+}
+
+static uint64_t
+hist_value(unsigned int index)
+{
+	if(index < (1 << HIST_SUB_BITS)) { return index; }
+
+	unsigned int group = index >> HIST_SUB_BITS;
+	unsigned int sub = index & ((1 << HIST_SUB_BITS) - 1);
+	return (uint64_t)((1 << HIST_SUB_BITS) + sub) << (group - 1);
+}
+
+static uint64_t
+hist_percentile(bench_t* bench, double percentile)
+{
+	uint64_t threshold = (uint64_t)(bench->num_steps * percentile);
+	uint64_t count = 0;
+
+	for(unsigned int i = 0; i < HIST_NUM_BUCKETS; ++i)
+	{
+		count += bench->histogram[i];
+		if(count > threshold) { return hist_value(i); }
+	}
+
+	return bench->max_step;
+}
+
+static void
+scan_obj(ugc_t* gc, ugc_header_t* header)
+{
+	bench_t* bench = gc->userdata;
+	size_t num_slots;
+	bench_obj_t** slots;
+
+	if(header != NULL)
+	{
+		bench_obj_t* obj = (bench_obj_t*)header;
+		num_slots = obj->num_refs;
+		slots = obj->refs;
+	}
+	else
+	{
+		num_slots = bench->num_roots;
+		slots = bench->roots;
+	}
+
+	for(size_t i = 0; i < num_slots; ++i)
+	{
+		bench_obj_t* obj = slots[i];
+		if(obj != NULL) { ugc_visit(gc, &obj->header); }
+	}
+}
+
+static void
+release_obj(ugc_t* gc, ugc_header_t* header)
+{
+	bench_t* bench = gc->userdata;
+	++bench->num_swept;
+	--bench->num_live;
+	free(header);
+}
+
+#if UGC_USE_LAYOUT
+static const ugc_layout_range_t bench_obj_ranges[] = {
+	{ offsetof(bench_obj_t, refs), offsetof(bench_obj_t, num_refs), 0 },
+};
+
+static const ugc_layout_t bench_obj_layout = {
+	.ranges = bench_obj_ranges,
+	.num_ranges = 1,
+};
+#endif
+
+static void
+step(bench_t* bench)
+{
+	unsigned char state = bench->gc.state;
+	uint64_t start = now();
+	ugc_step(&bench->gc);
+	uint64_t elapsed = now() - start;
+
+	// Scanning an object takes exactly one step, unlike the rare root rescans.
+	// This also counts objects traced according to their layout.
+	if(state == UGC_MARK) { ++bench->num_marked; }
+
+	++bench->num_steps;
+	++bench->histogram[hist_index(elapsed)];
+	bench->phase_time[state] += elapsed;
+	if(elapsed > bench->max_step) { bench->max_step = elapsed; }
+}
+
+static bench_obj_t*
+alloc(bench_t* bench, size_t num_refs)
+{
+	for(int i = 0; i < STEPS_PER_ALLOC; ++i) { step(bench); }
+
+	bench_obj_t* obj = malloc(sizeof(bench_obj_t) + sizeof(bench_obj_t*) * num_refs);
+	if(obj == NULL) { abort(); }
+
+#if UGC_USE_LAYOUT
+	obj->layout = &bench_obj_layout;
+#endif
+	obj->num_refs = num_refs;
+	memset(obj->refs, 0, sizeof(bench_obj_t*) * num_refs);
+	ugc_register(&bench->gc, &obj->header);
+
+	++bench->num_allocs;
+	++bench->num_live;
+	if(bench->num_live > bench->peak_live) { bench->peak_live = bench->num_live; }
+
+	return obj;
+}
+
+static void
+set_ref(
+	bench_t* bench,
+	enum ugc_barrier_direction_e direction,
+	bench_obj_t* src,
+	size_t index,
+	bench_obj_t* dst
+)
+{
+	src->refs[index] = dst;
+	if(dst != NULL)
+	{
+		ugc_write_barrier(&bench->gc, direction, &src->header, &dst->header);
+	}
+}
+
+static uint32_t
+next_random(uint32_t* state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+static bench_obj_t*
+make_tree(bench_t* bench, unsigned int depth)
+{
+	bench_obj_t* node = alloc(bench, 2);
+	if(depth == 0) { return node; }
+
+	// Keep the node reachable while its children are being built
+	bench->roots[2 + depth] = node;
+	bench_obj_t* left = make_tree(bench, depth - 1);
+	set_ref(bench, UGC_BARRIER_BACKWARD, node, 0, left);
+	bench_obj_t* right = make_tree(bench, depth - 1);
+	set_ref(bench, UGC_BARRIER_BACKWARD, node, 1, right);
+	bench->roots[2 + depth] = NULL;
+
+	return node;
+}
+
+static void
+binary_trees(bench_t* bench, unsigned int scale)
+{
+	// A long-lived tree in the first root, a temporary one in the second and
+	// a stack of nodes under construction after that.
+	bench->num_roots = 2 + 17;
+	bench->roots = calloc(bench->num_roots, sizeof(bench_obj_t*));
+
+	bench->roots[0] = make_tree(bench, 16);
+
+	for(unsigned int i = 0; i < 64 * scale; ++i)
+	{
+		bench->roots[1] = make_tree(bench, 12);
+	}
+}
+
+static void
+linked_list(bench_t* bench, unsigned int scale)
+{
+	bench->num_roots = 1;
+	bench->roots = calloc(bench->num_roots, sizeof(bench_obj_t*));
+
+	size_t length = 100000 * scale;
+	for(size_t i = 0; i < length * 3; ++i)
+	{
+		bench_obj_t* node = alloc(bench, 1);
+		set_ref(bench, UGC_BARRIER_FORWARD, node, 0, bench->roots[0]);
+		bench->roots[0] = node;
+
+		// Periodically drop the list so that it stays around `length`
+		if(i % length == length - 1) { bench->roots[0] = NULL; }
+	}
+}
+
+static void
+wide_array(bench_t* bench, unsigned int scale)
+{
+	bench->num_roots = 1;
+	bench->roots = calloc(bench->num_roots, sizeof(bench_obj_t*));
+
+	size_t width = 100000 * scale;
+	uint32_t seed = 1;
+	bench_obj_t* array = alloc(bench, width);
+	bench->roots[0] = array;
+
+	for(size_t i = 0; i < width * 4; ++i)
+	{
+		bench_obj_t* leaf = alloc(bench, 0);
+		size_t index = i < width ? i : next_random(&seed) % width;
+		// A backward barrier would rescan the whole array after every store
+		set_ref(bench, UGC_BARRIER_FORWARD, array, index, leaf);
+	}
+}
+
+static void
+churn(bench_t* bench, unsigned int scale)
+{
+	bench->num_roots = 64;
+	bench->roots = calloc(bench->num_roots, sizeof(bench_obj_t*));
+
+	uint32_t seed = 1;
+	for(size_t i = 0; i < 1000000 * (size_t)scale; ++i)
+	{
+		bench_obj_t* obj = alloc(bench, next_random(&seed) % 4);
+		bench->roots[next_random(&seed) % bench->num_roots] = obj;
+	}
+}
+
+static void
+barrier_heavy(bench_t* bench, unsigned int scale)
+{
+	const size_t num_objs = 10000;
+	const size_t num_refs = 8;
+	const size_t batch = 1024;
+
+	bench->num_roots = 1;
+	bench->roots = calloc(bench->num_roots, sizeof(bench_obj_t*));
+
+	bench_obj_t* table = alloc(bench, num_objs);
+	bench->roots[0] = table;
+	for(size_t i = 0; i < num_objs; ++i)
+	{
+		set_ref(bench, UGC_BARRIER_BACKWARD, table, i, alloc(bench, num_refs));
+	}
+
+	// Time batches of stores with and without barriers while the GC runs
+	uint32_t seed = 1;
+	uint64_t store_time = 0;
+	for(size_t i = 0; i < 2000 * (size_t)scale; ++i)
+	{
+		for(int j = 0; j < 10; ++j) { step(bench); }
+
+		uint32_t batch_seed = seed;
+		uint64_t start = now();
+		for(size_t j = 0; j < batch; ++j)
+		{
+			bench_obj_t* src = table->refs[next_random(&seed) % num_objs];
+			bench_obj_t* dst = table->refs[next_random(&seed) % num_objs];
+			set_ref(bench, j % 2 ? UGC_BARRIER_FORWARD : UGC_BARRIER_BACKWARD, src, j % num_refs, dst);
+		}
+		bench->barrier_time += now() - start;
+		bench->num_barriers += batch;
+
+		seed = batch_seed;
+		start = now();
+		for(size_t j = 0; j < batch; ++j)
+		{
+			bench_obj_t* src = table->refs[next_random(&seed) % num_objs];
+			bench_obj_t* dst = table->refs[next_random(&seed) % num_objs];
+			src->refs[j % num_refs] = dst;
+			__asm__ volatile("" : : "r"(src) : "memory");
+		}
+		store_time += now() - start;
+	}
+
+	bench->barrier_time = bench->barrier_time > store_time
+		? bench->barrier_time - store_time
+		: 0;
+}
+
+static const struct workload_s workloads[] = {
+	{ "binary_trees", binary_trees },
+	{ "linked_list", linked_list },
+	{ "wide_array", wide_array },
+	{ "churn", churn },
+	{ "barrier_heavy", barrier_heavy },
+};
+
+static double
+per_second(uint64_t count, uint64_t ns)
+{
+	return ns > 0 ? (double)count * 1e9 / (double)ns : 0.0;
+}
+
+#if UGC_USE_RECORD
+static void
+write_file(void* ctx, const void* data, size_t size)
+{
+	fwrite(data, 1, size, ctx);
+}
+#endif
+
+static void
+run(const struct workload_s* workload, unsigned int scale)
+{
+	bench_t* bench = calloc(1, sizeof(bench_t));
+	ugc_init(&bench->gc, scan_obj, release_obj);
+	bench->gc.userdata = bench;
+#if UGC_USE_LAYOUT
+	bench->gc.layout_offset = offsetof(bench_obj_t, layout);
+#endif
+
+#if UGC_USE_RECORD
+	FILE* record = NULL;
+	const char* record_prefix = getenv("BENCH_RECORD");
+	if(record_prefix != NULL)
+	{
+		char path[256];
+		snprintf(path, sizeof(path), "%s%s.ugcr", record_prefix, workload->name);
+		record = fopen(path, "wb");
+		if(record != NULL) { ugc_record_start(&bench->gc, write_file, record); }
+	}
+#endif
+
+	uint64_t start = now();
+	workload->run(bench, scale);
+	uint64_t total = now() - start;
+
+	printf(
+		"%-14s %10.3f %10" PRIu64 " %12.0f %12.0f %10" PRIu64 " %10" PRIu64 " %10" PRIu64,
+		workload->name,
+		(double)total / 1e9,
+		bench->num_allocs,
+		per_second(bench->num_marked, bench->phase_time[UGC_IDLE] + bench->phase_time[UGC_MARK]),
+		per_second(bench->num_swept, bench->phase_time[UGC_SWEEP]),
+		hist_percentile(bench, 0.99),
+		bench->max_step,
+		bench->peak_live
+	);
+	if(bench->num_barriers > 0)
+	{
+		printf(" %10.2f", (double)bench->barrier_time / (double)bench->num_barriers);
+	}
+	printf("\n");
+
+	ugc_release_all(&bench->gc);
+
+#if UGC_USE_RECORD
+	if(record != NULL)
+	{
+		ugc_record_stop(&bench->gc);
+		fclose(record);
+	}
+#endif
+
+	free(bench->roots);
+	free(bench);
+}
+
+int
+main(int argc, char* argv[])
+{
+	unsigned int scale = 1;
+	const char* scale_env = getenv("BENCH_SCALE");
+	if(scale_env != NULL && atoi(scale_env) > 0) { scale = atoi(scale_env); }
+
+	printf(
+		"%-14s %10s %10s %12s %12s %10s %10s %10s %10s\n",
+		"workload", "time (s)", "allocs", "marked/s", "swept/s",
+		"p99 (ns)", "max (ns)", "peak live", "barrier (ns)"
+	);
+
+	size_t num_workloads = sizeof(workloads) / sizeof(workloads[0]);
+	for(size_t i = 0; i < num_workloads; ++i)
+	{
+		bool selected = argc <= 1;
+		for(int j = 1; j < argc; ++j)
+		{
+			selected = selected || strcmp(argv[j], workloads[i].name) == 0;
+		}
+
+		if(selected) { run(&workloads[i], scale); }
+	}
+
+	return 0;
+}
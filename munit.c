@@ -1,12 +1,115 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 #include <munit/munit.h>
 
 #ifndef UGC_IMPLEMENTATION
 #define UGC_IMPLEMENTATION
 #endif
 
+#ifndef UGC_USE_THREADS
+#define UGC_USE_THREADS 1
+#endif
+
+#ifndef UGC_USE_STATS
+#define UGC_USE_STATS 1
+#endif
+
+#ifndef UGC_USE_TRACE
+#define UGC_USE_TRACE 1
+#endif
+
+#ifndef UGC_USE_RECORD
+#define UGC_USE_RECORD 1
+#endif
+
+#ifndef UGC_USE_PROFILE
+#define UGC_USE_PROFILE 1
+#endif
+
+#ifndef UGC_USE_PACER
+#define UGC_USE_PACER 1
+#endif
+
+#ifndef UGC_USE_LAYOUT
+#define UGC_USE_LAYOUT 1
+#endif
+
+#ifndef UGC_USE_CONSERVATIVE
+#define UGC_USE_CONSERVATIVE 1
+#endif
+
+#ifndef UGC_USE_FIBERS
+#define UGC_USE_FIBERS 1
+#endif
+
+#ifndef UGC_USE_PINS
+#define UGC_USE_PINS 1
+#endif
+
+#ifndef UGC_USE_WEAK
+#define UGC_USE_WEAK 1
+#endif
+
+#ifndef UGC_USE_EPOCHS
+#define UGC_USE_EPOCHS UGC_USE_THREADS
+#endif
+
+#ifndef UGC_USE_LARGE
+#define UGC_USE_LARGE 1
+#endif
+
+#ifndef UGC_USE_REGIONS
+#define UGC_USE_REGIONS 1
+#endif
+
+#ifndef UGC_USE_FINALIZERS
+#define UGC_USE_FINALIZERS 1
+#endif
+
+#ifndef UGC_USE_EVACUATION
+#define UGC_USE_EVACUATION !UGC_USE_THREADS
+#endif
+
+#ifndef UGC_USE_SORT
+#define UGC_USE_SORT 1
+#endif
+
+// Small enough to test incremental scanning
+#define UGC_PIN_SCAN_CHUNK 2
+#define UGC_SORT_CHUNK 4
+
+#if !defined(UGC_USE_PERF) && defined(__linux__)
+#define UGC_USE_PERF UGC_USE_STATS
+#endif
+
+#if UGC_USE_THREADS
+#include <pthread.h>
+#include <stdatomic.h>
+#endif
+
+#if UGC_USE_PACER
+#include <time.h>
+
+// When not 0, replaces the real clock
+static uint64_t fake_clock = 0;
+
+static uint64_t
+test_clock(void)
+{
+	if(fake_clock != 0) { return fake_clock; }
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+#define UGC_CLOCK() test_clock()
+#endif
+
 #include "ugc.h"
 
 typedef struct gc_obj_s gc_obj_t;
@@ -75,6 +178,22 @@ teardown(void* fixture_)
 	free(fixture);
 }
 
+typedef struct buffer_s
+{
+	char data[4096];
+	size_t size;
+} buffer_t;
+
+static void
+write_buffer(void* ctx, const void* data, size_t size)
+{
+	buffer_t* buf = ctx;
+	munit_assert_size(buf->size + size, <, sizeof(buf->data));
+	memcpy(buf->data + buf->size, data, size);
+	buf->size += size;
+	buf->data[buf->size] = '\0';
+}
+
 static void
 alloc(ugc_t* gc, gc_obj_t* obj)
 {
@@ -319,43 +438,2798 @@ release_all(const MunitParameter params[], void* fixture_)
 	return MUNIT_OK;
 }
 
-static MunitTest tests[] = {
+static MunitResult
+release_all_sweep(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+	fixture_t* fixture = fixture_;
+	ugc_t* gc = fixture->gc;
+
+	gc_obj_t a, b, c;
+
+	alloc(gc, &a);
+	alloc(gc, &b);
+	alloc(gc, &c);
+
+	fixture->root = &a;
+
+	while(gc->state != UGC_SWEEP) { ugc_step(gc); }
+	ugc_step(gc);
+
+	// free_gc_obj asserts that objects are not released twice
+	ugc_release_all(gc);
+
+	munit_assert_true(!a.live);
+	munit_assert_true(!b.live);
+	munit_assert_true(!c.live);
+
+	return MUNIT_OK;
+}
+
+static MunitResult
+collect_full(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+	fixture_t* fixture = fixture_;
+	ugc_t* gc = fixture->gc;
+
+	for(int state = UGC_IDLE; state <= UGC_SWEEP; ++state)
 	{
-		.name = "/basic",
-		.test = basic,
-		.setup = setup,
-		.tear_down = teardown
-	},
+		gc_obj_t a, b, c, d;
+
+		alloc(gc, &a);
+		alloc(gc, &b);
+		alloc(gc, &c);
+		set_ref(gc, &a, &b);
+		set_ref(gc, &b, &c);
+		fixture->root = &a;
+
+		while(ugc_color(&c.header) != !gc->white) { ugc_step(gc); }
+		while(gc->state != state) { ugc_step(gc); }
+
+		alloc(gc, &d);
+		set_ref(gc, &c, &d);
+		set_ref(gc, &a, NULL);
+
+		ugc_collect_full(gc);
+
+		munit_assert_int(gc->state, ==, UGC_IDLE);
+		munit_assert_true(a.live);
+		munit_assert_true(!b.live);
+		munit_assert_true(!c.live);
+		munit_assert_true(!d.live);
+
+		fixture->root = NULL;
+		ugc_collect_full(gc);
+		munit_assert_true(!a.live);
+	}
+
+	return MUNIT_OK;
+}
+
+#if UGC_USE_STATS
+
+static MunitResult
+stats(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+	fixture_t* fixture = fixture_;
+	ugc_t* gc = fixture->gc;
+
+	gc_obj_t a, b, c;
+
+	alloc(gc, &a);
+	alloc(gc, &b);
+	alloc(gc, &c);
+	set_ref(gc, &a, &b);
+	fixture->root = &a;
+
+	ugc_collect(gc);
+	ugc_collect(gc);
+
+	const ugc_stats_t* stats = &gc->stats;
+	munit_assert_uint(stats->num_cycles, ==, 2);
+	munit_assert_uint(stats->steps[UGC_PHASE_ROOT].count, ==, 2);
+	munit_assert_uint(stats->steps[UGC_PHASE_MARK].count, ==, 4);
+	munit_assert_uint(stats->steps[UGC_PHASE_TERMINATION].count, ==, 2);
+	// One step per released object and one to finish each cycle
+	munit_assert_uint(stats->steps[UGC_PHASE_SWEEP].count, ==, 3);
+	munit_assert_uint(stats->total_cycle_work, <=, stats->total_cycle_duration);
+
+	for(int i = 0; i < UGC_PHASE_COUNT; ++i)
 	{
-		.name = "/root",
-		.test = root,
-		.setup = setup,
-		.tear_down = teardown
-	},
+		const ugc_histogram_t* histogram = &stats->steps[i];
+		munit_assert_uint(ugc_histogram_percentile(histogram, 0.5), <=, histogram->max);
+		munit_assert_uint(ugc_histogram_percentile(histogram, 1.0), ==, histogram->max);
+	}
+
+	// Small values have a bucket of their own
+	ugc_histogram_t exact = { .count = 0 };
+	for(uint64_t value = 1; value <= 10; ++value) { ugc_histogram_record(&exact, value); }
+	munit_assert_uint(ugc_histogram_percentile(&exact, 0.0), ==, 1);
+	munit_assert_uint(ugc_histogram_percentile(&exact, 0.1), ==, 1);
+	munit_assert_uint(ugc_histogram_percentile(&exact, 0.5), ==, 5);
+	munit_assert_uint(ugc_histogram_percentile(&exact, 0.55), ==, 6);
+	munit_assert_uint(ugc_histogram_percentile(&exact, 0.99), ==, 10);
+
+		uint64_t values[] = { 0, 1, 15, 16, 17, 1000, 123456789, (uint64_t)1 << 39 };
+	for(size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i)
 	{
-		.name = "/write_barrier",
-		.test = write_barrier,
-		.setup = setup,
-		.tear_down = teardown
-	},
+		unsigned int index = ugc_histogram_index(values[i]);
+		munit_assert_uint(ugc_histogram_value(index), <=, values[i]);
+		munit_assert_uint(ugc_histogram_value(index + 1), >, values[i]);
+	}
+
+	ugc_collect_full(gc);
+	munit_assert_uint(stats->num_cycles, ==, 3);
+
+	ugc_stats_reset(gc);
+	munit_assert_uint(stats->num_cycles, ==, 0);
+	munit_assert_uint(stats->steps[UGC_PHASE_MARK].count, ==, 0);
+
+	return MUNIT_OK;
+}
+
+#endif
+
+#if UGC_USE_PERF
+
+static MunitResult
+perf(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+	fixture_t* fixture = fixture_;
+	ugc_t* gc = fixture->gc;
+
+	// Counters are usually unavailable in containers and VMs
+	if(ugc_perf_open(gc) != 0) { return MUNIT_SKIP; }
+
+	gc_obj_t a, b;
+
+	alloc(gc, &a);
+	alloc(gc, &b);
+	set_ref(gc, &a, &b);
+	fixture->root = &a;
+
+	ugc_collect(gc);
+
+	const ugc_stats_t* stats = &gc->stats;
+	uint64_t total = 0;
+	for(int i = 0; i < UGC_PHASE_COUNT; ++i)
 	{
-		.name = "/root_change",
-		.test = root_change,
-		.setup = setup,
-		.tear_down = teardown
-	},
+		munit_assert_uint64(
+			stats->counters[i][UGC_COUNTER_CACHE_MISSES], <=,
+			stats->counters[i][UGC_COUNTER_INSTRUCTIONS] + stats->counters[i][UGC_COUNTER_CYCLES]
+		);
+		for(int j = 0; j < UGC_COUNTER_COUNT; ++j) { total += stats->counters[i][j]; }
+	}
+	munit_assert_uint64(total, >, 0);
+
+	ugc_perf_close(gc);
+	ugc_stats_reset(gc);
+	ugc_collect(gc);
+	munit_assert_uint64(stats->counters[UGC_PHASE_MARK][UGC_COUNTER_CYCLES], ==, 0);
+
+	return MUNIT_OK;
+}
+
+#endif
+
+#if UGC_USE_RECORD
+
+static MunitResult
+record(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+	fixture_t* fixture = fixture_;
+	ugc_t* gc = fixture->gc;
+
+	buffer_t buf = { .size = 0 };
+	ugc_record_start(gc, write_buffer, &buf);
+
+	gc_obj_t a, b;
+
+	alloc(gc, &a);
+	alloc(gc, &b);
+	fixture->root = &a;
+	ugc_step(gc);
+	set_ref(gc, &a, &b);
+	ugc_collect_full(gc);
+	ugc_release_all(gc);
+
+	// Nothing is written until the buffer is full
+	munit_assert_size(buf.size, ==, 0);
+	ugc_record_stop(gc);
+	ugc_step(gc);
+
+	uintptr_t id_a = (uintptr_t)&a.header / _Alignof(ugc_header_t);
+	uintptr_t id_b = (uintptr_t)&b.header / _Alignof(ugc_header_t);
+	ugc_record_op_t expected[] = {
+		{ UGC_RECORD_REGISTER, id_a, 0 },
+		{ UGC_RECORD_REGISTER, id_b, 0 },
+		{ UGC_RECORD_SCAN_ROOTS, 0, 0 },
+		{ UGC_RECORD_EDGE, id_a, 0 },
+		{ UGC_RECORD_STEP, 0, 0 },
+		{ UGC_RECORD_BARRIER_BACKWARD, id_a, id_b },
+		{ UGC_RECORD_SCAN_ROOTS, 0, 0 },
+		{ UGC_RECORD_EDGE, id_a, 0 },
+		{ UGC_RECORD_SCAN, id_a, 0 },
+		{ UGC_RECORD_EDGE, id_b, 0 },
+		{ UGC_RECORD_SCAN, id_b, 0 },
+		{ UGC_RECORD_COLLECT_FULL, 0, 0 },
+		{ UGC_RECORD_RELEASE_ALL, 0, 0 },
+	};
+
+	ugc_record_reader_t reader;
+	ugc_record_op_t op;
+	munit_assert_int(ugc_record_reader_init(&reader, buf.data, buf.size), ==, 0);
+
+	for(size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); ++i)
 	{
-		.name = "/interupt_sweep",
-		.test = interupt_sweep,
-		.setup = setup,
-		.tear_down = teardown
-	},
+		munit_assert_int(ugc_record_read(&reader, &op), ==, 1);
+		munit_assert_int(op.type, ==, expected[i].type);
+		munit_assert_true(op.obj == expected[i].obj);
+		munit_assert_true(op.child == expected[i].child);
+	}
+	munit_assert_int(ugc_record_read(&reader, &op), ==, 0);
+
+	// Truncated in the middle of the last scan
+	munit_assert_int(ugc_record_reader_init(&reader, buf.data, buf.size - 3), ==, 0);
+	int result;
+	while((result = ugc_record_read(&reader, &op)) == 1) {}
+	munit_assert_int(result, ==, -1);
+	munit_assert_int(ugc_record_reader_init(&reader, buf.data + 1, buf.size - 1), ==, -1);
+
+#if UGC_USE_PINS
+	// Recording does not change how roots are scanned, rescans and pins
+	// scanned between objects add to the root
+	ugc_t pin_gc;
+	ugc_init(&pin_gc, scan_gc_obj, free_gc_obj);
+	pin_gc.userdata = fixture;
+	fixture->root = NULL;
+
+	gc_obj_t pinned[3];
+	uintptr_t pin_slots[3];
+	ugc_pins_init(&pin_gc, pin_slots, 3);
+	for(int i = 0; i < 3; ++i)
 	{
-		.name = "/release_all",
-		.test = release_all,
-		.setup = setup,
-		.tear_down = teardown
-	},
+		alloc(&pin_gc, &pinned[i]);
+		ugc_pin(&pin_gc, &pinned[i].header);
+	}
+
+	buf.size = 0;
+	ugc_record_start(&pin_gc, write_buffer, &buf);
+	ugc_collect(&pin_gc);
+	ugc_record_stop(&pin_gc);
+
+	size_t num_scans = 0;
+	size_t num_rescans = 0;
+	munit_assert_int(ugc_record_reader_init(&reader, buf.data, buf.size), ==, 0);
+	while(ugc_record_read(&reader, &op) == 1)
+	{
+		if(op.type == UGC_RECORD_SCAN_ROOTS) { ++num_scans; }
+		if(op.type == UGC_RECORD_RESCAN_ROOTS) { ++num_rescans; }
+	}
+	munit_assert_size(num_scans, ==, 1);
+	munit_assert_size(num_rescans, >=, 2);
+	for(int i = 0; i < 3; ++i) { munit_assert_true(pinned[i].live); }
+	ugc_release_all(&pin_gc);
+#endif
+
+	return MUNIT_OK;
+}
+
+#endif
+
+#if UGC_USE_PROFILE
+
+typedef struct profile_obj_s
+{
+	ugc_header_t header;
+	struct profile_obj_s* refs[2];
+	unsigned int type;
+	size_t size;
+} profile_obj_t;
+
+static void
+scan_profile_obj(ugc_t* gc, ugc_header_t* header)
+{
+	profile_obj_t* root = gc->userdata;
+	profile_obj_t* obj = header != NULL ? (profile_obj_t*)header : root;
+	size_t num_refs = header != NULL ? 2 : 1;
+
+	for(size_t i = 0; i < num_refs; ++i)
+	{
+		if(obj->refs[i] != NULL) { ugc_visit(gc, &obj->refs[i]->header); }
+	}
+}
+
+static void
+release_profile_obj(ugc_t* gc, ugc_header_t* header)
+{
+	(void)gc;
+	((profile_obj_t*)header)->size = 0;
+}
+
+static void
+describe_profile_obj(ugc_t* gc, ugc_profile_node_t* node)
+{
+	(void)gc;
+	profile_obj_t* obj = (profile_obj_t*)node->obj;
+	node->type = obj->type;
+	node->size = obj->size;
+}
+
+static MunitResult
+profile(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+	(void)fixture_;
+
+	// root -> a -> b -> d -> e -> a
+	//          \-> c -/
+	profile_obj_t root = { .refs = { NULL } };
+	profile_obj_t a = { .type = 0, .size = 1 };
+	profile_obj_t b = { .type = 0, .size = 2 };
+	profile_obj_t c = { .type = 0, .size = 4 };
+	profile_obj_t d = { .type = 1, .size = 8 };
+	profile_obj_t e = { .type = 1, .size = 16 };
+	profile_obj_t garbage = { .type = 1, .size = 32 };
+
+	root.refs[0] = &a;
+	a.refs[0] = &b;
+	a.refs[1] = &c;
+	b.refs[0] = &d;
+	c.refs[0] = &d;
+	d.refs[0] = &e;
+	e.refs[0] = &a;
+	garbage.refs[0] = &a;
+
+	ugc_t gc;
+	ugc_init(&gc, scan_profile_obj, release_profile_obj);
+	gc.userdata = &root;
+
+	profile_obj_t* objs[] = { &a, &b, &c, &d, &e, &garbage };
+	for(size_t i = 0; i < sizeof(objs) / sizeof(objs[0]); ++i)
+	{
+		ugc_register(&gc, &objs[i]->header);
+	}
+
+	// Profiling in the middle of a cycle does not disturb it
+	ugc_step(&gc);
+	ugc_step(&gc);
+
+	ugc_profile_node_t nodes[8];
+	size_t edges[8];
+	ugc_profile_t profile;
+	ugc_profile_init(&profile, nodes, 8, edges, 8);
+	munit_assert_int(ugc_profile_take(&gc, &profile, describe_profile_obj), ==, 0);
+
+	munit_assert_size(profile.num_nodes, ==, 6);
+	munit_assert_size(profile.num_edges, ==, 7);
+	munit_assert_ptr_equal(nodes[1].obj, &a.header);
+	munit_assert_ptr_equal(nodes[5].obj, &e.header);
+
+	size_t expected_dominators[] = { 0, 0, 1, 1, 1, 4 };
+	size_t expected_retained[] = { 31, 31, 2, 4, 24, 16 };
+	for(size_t i = 0; i < profile.num_nodes; ++i)
+	{
+		munit_assert_size(nodes[i].dominator, ==, expected_dominators[i]);
+		munit_assert_size(nodes[i].retained, ==, expected_retained[i]);
+	}
+
+	ugc_profile_type_t types[2];
+	ugc_profile_aggregate(&profile, types, 2);
+	munit_assert_size(types[0].count, ==, 3);
+	munit_assert_size(types[0].size, ==, 7);
+	munit_assert_size(types[0].retained, ==, 31);
+	munit_assert_size(types[1].count, ==, 2);
+	munit_assert_size(types[1].size, ==, 24);
+	munit_assert_size(types[1].retained, ==, 24);
+
+	buffer_t buf = { .size = 0 };
+	const char* type_names[] = { "Foo", "Bar" };
+	ugc_profile_write(&profile, type_names, 2, write_buffer, &buf);
+	munit_assert_true(strncmp(buf.data, "{\"snapshot\":", 12) == 0);
+	munit_assert_not_null(strstr(buf.data, "\"node_count\":6,\"edge_count\":7"));
+	munit_assert_not_null(strstr(buf.data, "\"strings\":[\"(GC roots)\",\"Foo\",\"Bar\""));
+
+	// Too small
+	ugc_profile_init(&profile, nodes, 3, edges, 8);
+	munit_assert_int(ugc_profile_take(&gc, &profile, describe_profile_obj), ==, -1);
+
+	// Links are restored
+	ugc_collect(&gc);
+	ugc_collect(&gc);
+	for(size_t i = 0; i < sizeof(objs) / sizeof(objs[0]); ++i)
+	{
+		munit_assert_true((objs[i]->size == 0) == (objs[i] == &garbage));
+	}
+
+	size_t num_live = 0;
+	for(ugc_header_t* itr = ugc_next(gc.from); itr != gc.from; itr = ugc_next(itr))
+	{
+		++num_live;
+	}
+	munit_assert_size(num_live, ==, 5);
+
+	return MUNIT_OK;
+}
+
+#endif
+
+#if UGC_USE_PACER
+
+#define PACER_ROOT_COST 1000
+#define PACER_SCAN_COST 100
+#define PACER_RELEASE_COST 50
+#define PACER_ALLOC_COST 300
+
+static void
+scan_paced(ugc_t* gc, ugc_header_t* obj)
+{
+	fake_clock += obj != NULL ? PACER_SCAN_COST : PACER_ROOT_COST;
+	scan_gc_obj(gc, obj);
+}
+
+static void
+release_paced(ugc_t* gc, ugc_header_t* obj)
+{
+	fake_clock += PACER_RELEASE_COST;
+	free_gc_obj(gc, obj);
+}
+
+static MunitResult
+pacer(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+	fixture_t* fixture = fixture_;
+	ugc_t* gc = fixture->gc;
+
+	ugc_init(gc, scan_paced, release_paced);
+	gc->userdata = fixture;
+	gc->pause_target = 5000;
+	gc->cpu_share = 0.25;
+	fake_clock = 1;
+
+	enum { NUM_OBJS = 2000 };
+	gc_obj_t* objs = malloc(sizeof(gc_obj_t) * NUM_OBJS);
+	uint64_t gc_time = 0;
+
+	for(int i = 0; i < NUM_OBJS; ++i)
+	{
+		fake_clock += PACER_ALLOC_COST;
+
+		// Chains of 10 objects, only the last one is reachable
+		alloc(gc, &objs[i]);
+		if(i % 10 != 0) { set_ref(gc, &objs[i], &objs[i - 1]); }
+		fixture->root = &objs[i];
+
+		uint64_t start = fake_clock;
+		ugc_pace(gc);
+		uint64_t pause = fake_clock - start;
+		gc_time += pause;
+
+		munit_assert_uint64(pause, <=, gc->pause_target + PACER_ROOT_COST);
+	}
+
+	// Step costs are learnt
+	munit_assert_uint64(gc->step_cost[UGC_PHASE_ROOT], ==, PACER_ROOT_COST);
+	munit_assert_uint64(gc->step_cost[UGC_PHASE_MARK], >=, PACER_SCAN_COST - 1);
+	munit_assert_uint64(gc->step_cost[UGC_PHASE_MARK], <=, PACER_SCAN_COST);
+
+	// Collection keeps up with allocation
+	int num_live = 0;
+	for(int i = 0; i < NUM_OBJS; ++i) { num_live += objs[i].live; }
+	munit_assert_int(num_live, <, NUM_OBJS / 4);
+
+	// A CPU share of 1/4 is 1/3 of the mutator time
+	uint64_t mutator_time = (uint64_t)NUM_OBJS * PACER_ALLOC_COST;
+	munit_assert_uint64(gc_time, >=, mutator_time / 3 - gc->pause_target);
+	munit_assert_uint64(gc_time, <=, mutator_time / 3 + gc->pause_target);
+
+	// Without allocation, the collector finishes its cycle then stays idle
+	for(int i = 0; i < 100; ++i)
+	{
+		fake_clock += PACER_ALLOC_COST;
+		ugc_pace(gc);
+	}
+	munit_assert_int(gc->state, ==, UGC_IDLE);
+
+	uint64_t start = fake_clock;
+	ugc_pace(gc);
+	munit_assert_uint64(fake_clock, ==, start);
+
+	// Out of range shares are clamped
+	gc->cpu_share = 1.0;
+	fake_clock += PACER_ALLOC_COST;
+	ugc_pace(gc);
+	munit_assert_true(gc->pace_credit > 0);
+	gc->cpu_share = -1.0;
+	int64_t credit = gc->pace_credit;
+	fake_clock += PACER_ALLOC_COST;
+	ugc_pace(gc);
+	munit_assert_true(gc->pace_credit == credit);
+
+	fake_clock = 0;
+	ugc_release_all(gc);
+	free(objs);
+
+	return MUNIT_OK;
+}
+
+#endif
+
+#if UGC_USE_LAYOUT
+
+typedef struct layout_obj_s layout_obj_t;
+
+struct layout_obj_s
+{
+	ugc_header_t header;
+	const ugc_layout_t* layout;
+	layout_obj_t* left;
+	int padding;
+	layout_obj_t* right;
+	layout_obj_t** extra;
+	size_t num_extra;
+	size_t num_items;
+	layout_obj_t* items[4];
+	bool live;
+};
+
+static const size_t layout_obj_fields[] = {
+	offsetof(layout_obj_t, left),
+	offsetof(layout_obj_t, right),
+};
+
+static const ugc_layout_range_t layout_obj_ranges[] = {
+	{ offsetof(layout_obj_t, items), offsetof(layout_obj_t, num_items), 0 },
+	{ offsetof(layout_obj_t, extra), offsetof(layout_obj_t, num_extra), 1 },
+};
+
+static const ugc_layout_t layout_obj_layout = {
+	.fields = layout_obj_fields,
+	.num_fields = 2,
+	.ranges = layout_obj_ranges,
+	.num_ranges = 2,
+};
+
+static void
+scan_layout_obj(ugc_t* gc, ugc_header_t* header)
+{
+	layout_obj_t* root = gc->userdata;
+	layout_obj_t* obj = header != NULL ? (layout_obj_t*)header : root;
+
+	// Only objects without layout are scanned here
+	munit_assert_true(header == NULL || obj->layout == NULL);
+	++root->padding;
+
+	if(obj->left != NULL) { ugc_visit(gc, &obj->left->header); }
+}
+
+static void
+release_layout_obj(ugc_t* gc, ugc_header_t* header)
+{
+	(void)gc;
+	layout_obj_t* obj = (layout_obj_t*)header;
+	munit_assert_true(obj->live);
+	obj->live = false;
+}
+
+static MunitResult
+layout(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+	(void)fixture_;
+
+	layout_obj_t root = { .layout = NULL };
+	layout_obj_t objs[7];
+	layout_obj_t* extra[2];
+
+	ugc_t gc;
+	ugc_init(&gc, scan_layout_obj, release_layout_obj);
+	gc.userdata = &root;
+	gc.layout_offset = offsetof(layout_obj_t, layout);
+
+	for(int i = 0; i < 7; ++i)
+	{
+		objs[i] = (layout_obj_t){ .layout = &layout_obj_layout, .live = true };
+		ugc_register(&gc, &objs[i].header);
+	}
+
+	// root -> 0 -> left: 1 (no layout) -> left: 2
+	//           -> items: 3, NULL
+	//           -> extra: 4, 5
+	// 6 is garbage
+	root.left = &objs[0];
+	objs[0].left = &objs[1];
+	objs[1].layout = NULL;
+	objs[1].left = &objs[2];
+	objs[0].items[0] = &objs[3];
+	objs[0].items[1] = NULL;
+	objs[0].items[2] = &objs[6];
+	objs[0].num_items = 2;
+	extra[0] = &objs[4];
+	extra[1] = &objs[5];
+	objs[0].extra = extra;
+	objs[0].num_extra = 2;
+	objs[6].right = &objs[0];
+
+	ugc_collect(&gc);
+	ugc_collect(&gc);
+
+	for(int i = 0; i < 6; ++i) { munit_assert_true(objs[i].live); }
+	munit_assert_false(objs[6].live);
+
+	// Root (scanned then rescanned) and object 1, in both cycles
+	munit_assert_int(root.padding, ==, 6);
+
+	objs[0].extra = NULL;
+	ugc_collect_full(&gc);
+	munit_assert_false(objs[4].live);
+	munit_assert_false(objs[5].live);
+
+	ugc_release_all(&gc);
+
+	return MUNIT_OK;
+}
+
+#endif
+
+#if UGC_USE_CONSERVATIVE
+
+#define INDEX_NUM_OBJS 64
+
+typedef struct index_obj_s
+{
+	ugc_header_t header;
+	char data[100];
+} index_obj_t;
+
+static MunitResult
+address_index(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+	(void)fixture_;
+
+	static ugc_index_entry_t entries[512];
+	static index_obj_t objs[INDEX_NUM_OBJS];
+	static bool indexed[INDEX_NUM_OBJS];
+
+	ugc_index_t index;
+	ugc_index_init(&index, entries, 512);
+
+	for(int i = 0; i < INDEX_NUM_OBJS; ++i)
+	{
+		munit_assert_int(ugc_index_add(&index, &objs[i].header, sizeof(index_obj_t)), ==, 0);
+		indexed[i] = true;
+	}
+
+	munit_assert_null(ugc_index_find(&index, &index));
+	munit_assert_null(ugc_index_find(&index, &objs[INDEX_NUM_OBJS]));
+
+	// Remove in a pseudo-random order, checking every object each time
+	uint32_t seed = 1;
+	for(int num_removed = 0; num_removed <= INDEX_NUM_OBJS; ++num_removed)
+	{
+		for(int i = 0; i < INDEX_NUM_OBJS; ++i)
+		{
+			const char* start = (const char*)&objs[i];
+			ugc_header_t* expected = indexed[i] ? &objs[i].header : NULL;
+			munit_assert_ptr_equal(ugc_index_find(&index, start), expected);
+			munit_assert_ptr_equal(ugc_index_find(&index, start + 50), expected);
+			munit_assert_ptr_equal(ugc_index_find(&index, start + sizeof(index_obj_t) - 1), expected);
+		}
+
+		if(num_removed == INDEX_NUM_OBJS) { break; }
+
+		int victim;
+		do
+		{
+			seed = seed * 1103515245 + 12345;
+			victim = (int)((seed >> 16) % INDEX_NUM_OBJS);
+		} while(!indexed[victim]);
+
+		ugc_index_remove(&index, &objs[victim].header);
+		indexed[victim] = false;
+	}
+
+	munit_assert_size(index.num_entries, ==, 0);
+
+	// Removing an object which is not indexed does nothing
+	ugc_index_remove(&index, &objs[0].header);
+
+	// The index is never more than 3/4 full
+	ugc_index_init(&index, entries, 64);
+	int num_added = 0;
+	while(ugc_index_add(&index, &objs[num_added].header, sizeof(index_obj_t)) == 0)
+	{
+		++num_added;
+	}
+	munit_assert_size(index.num_entries, <=, 48);
+	munit_assert_size(index.num_entries, >, 48 - 3);
+	munit_assert_null(ugc_index_find(&index, &objs[num_added]));
+
+	return MUNIT_OK;
+}
+
+static struct
+{
+	const void* begin;
+	const void* end;
+	const void* stack_base;
+} conservative_roots;
+
+static void
+scan_conservative(ugc_t* gc, ugc_header_t* obj)
+{
+	if(obj != NULL)
+	{
+		scan_gc_obj(gc, obj);
+		return;
+	}
+
+	if(conservative_roots.stack_base != NULL)
+	{
+		ugc_scan_stack(gc, conservative_roots.stack_base);
+	}
+	else
+	{
+		ugc_scan_range(gc, conservative_roots.begin, conservative_roots.end);
+	}
+}
+
+static MunitResult
+conservative(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+	fixture_t* fixture = fixture_;
+	ugc_t* gc = fixture->gc;
+	gc->scan_fn = scan_conservative;
+
+	ugc_index_entry_t entries[64];
+	ugc_index_t index;
+	ugc_index_init(&index, entries, 64);
+	gc->index = &index;
+
+	conservative_roots.stack_base = NULL;
+
+	gc_obj_t* objs = malloc(5 * sizeof(gc_obj_t));
+	for(int i = 0; i < 5; ++i)
+	{
+		alloc(gc, &objs[i]);
+		munit_assert_int(ugc_index_add(&index, &objs[i].header, sizeof(gc_obj_t)), ==, 0);
+	}
+
+	// Interior pointer to 0, misaligned word, pointer to 2 which refers to 3
+	uintptr_t words[5] = {
+		(uintptr_t)&objs[0].ref,
+		42,
+		(uintptr_t)&objs[2],
+		0,
+	};
+	char* misaligned = (char*)&words[3] + 1;
+	uintptr_t pointer_to_4 = (uintptr_t)&objs[4];
+	memcpy(misaligned, &pointer_to_4, sizeof(uintptr_t));
+	objs[2].ref = &objs[3];
+
+	conservative_roots.begin = words;
+	conservative_roots.end = &words[5];
+
+	ugc_collect(gc);
+	ugc_collect(gc);
+
+	munit_assert_true(objs[0].live);
+	munit_assert_false(objs[1].live);
+	munit_assert_true(objs[2].live);
+	munit_assert_true(objs[3].live);
+	munit_assert_false(objs[4].live);
+
+	// Released objects left the index
+	munit_assert_null(ugc_index_find(&index, &objs[1]));
+	munit_assert_ptr_equal(ugc_index_find(&index, &objs[3].live), &objs[3].header);
+
+	// A reference only held by this function
+	gc_obj_t* volatile held = malloc(sizeof(gc_obj_t));
+	alloc(gc, held);
+	munit_assert_int(ugc_index_add(&index, &held->header, sizeof(gc_obj_t)), ==, 0);
+
+	conservative_roots.stack_base = __builtin_frame_address(0);
+	ugc_collect(gc);
+	ugc_collect(gc);
+	munit_assert_true(held->live);
+
+	ugc_release_all(gc);
+	munit_assert_size(index.num_entries, ==, 0);
+
+	free(held);
+	free(objs);
+
+	return MUNIT_OK;
+}
+
+#if UGC_USE_THREADS
+
+struct conservative_mutator_s
+{
+	ugc_t* gc;
+	ugc_thread_t thread;
+	gc_obj_t* obj;
+	atomic_int phase;
+};
+
+static void
+scan_conservative_mutator(ugc_t* gc, ugc_thread_t* thread)
+{
+	ugc_scan_thread(gc, thread);
+}
+
+static void*
+run_conservative_mutator(void* mutator_)
+{
+	struct conservative_mutator_s* mutator = mutator_;
+	ugc_t* gc = mutator->gc;
+
+	mutator->thread.stack_base = __builtin_frame_address(0);
+	ugc_thread_attach(gc, &mutator->thread, scan_conservative_mutator);
+
+	// Only this frame refers to the object
+	gc_obj_t* volatile obj = mutator->obj;
+	mutator->obj = NULL;
+	atomic_store(&mutator->phase, 1);
+
+	while(atomic_load(&mutator->phase) == 1) { ugc_safepoint(gc, &mutator->thread); }
+
+	munit_assert_true(obj->live);
+	mutator->obj = obj;
+
+	ugc_thread_detach(gc, &mutator->thread);
+	return NULL;
+}
+
+static MunitResult
+conservative_threads(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+	fixture_t* fixture = fixture_;
+	ugc_t* gc = fixture->gc;
+
+	ugc_index_entry_t entries[64];
+	ugc_index_t index;
+	ugc_index_init(&index, entries, 64);
+	gc->index = &index;
+
+	struct conservative_mutator_s mutator = {
+		.gc = gc,
+		.obj = malloc(sizeof(gc_obj_t)),
+	};
+	atomic_init(&mutator.phase, 0);
+	alloc(gc, mutator.obj);
+	munit_assert_int(ugc_index_add(&index, &mutator.obj->header, sizeof(gc_obj_t)), ==, 0);
+
+	pthread_t handle;
+	pthread_create(&handle, NULL, run_conservative_mutator, &mutator);
+	while(atomic_load(&mutator.phase) == 0) { sched_yield(); }
+
+	for(int i = 0; i < 2; ++i)
+	{
+		ugc_safepoint_begin(gc, NULL);
+		ugc_collect(gc);
+		ugc_safepoint_end(gc);
+	}
+
+	atomic_store(&mutator.phase, 2);
+	pthread_join(handle, NULL);
+	munit_assert_true(mutator.obj->live);
+
+	ugc_release_all(gc);
+	free(mutator.obj);
+
+	return MUNIT_OK;
+}
+
+#if UGC_BLOCK_STUB && defined(__x86_64__)
+
+#define BLOCKED_MASK ((uintptr_t)0xa5a5a5a5a5a5a5a5ull)
+
+static void
+wait_blocked(struct conservative_mutator_s* mutator)
+{
+	atomic_store(&mutator->phase, 1);
+	while(atomic_load(&mutator->phase) == 1) { sched_yield(); }
+}
+
+static void*
+run_blocked_mutator(void* mutator_)
+{
+	struct conservative_mutator_s* mutator = mutator_;
+	ugc_t* gc = mutator->gc;
+
+	mutator->thread.stack_base = __builtin_frame_address(0);
+	ugc_thread_attach(gc, &mutator->thread, scan_conservative_mutator);
+
+	// The reference is masked everywhere but in rbp, which glibc mangles in a
+	// jmp_buf, while the thread is blocked
+	uintptr_t masked = (uintptr_t)mutator->obj ^ BLOCKED_MASK;
+	mutator->obj = NULL;
+	uintptr_t args[7] = {
+		(uintptr_t)gc,
+		(uintptr_t)&mutator->thread,
+		(uintptr_t)mutator,
+		BLOCKED_MASK,
+		(uintptr_t)ugc_thread_block,
+		(uintptr_t)wait_blocked,
+		(uintptr_t)ugc_thread_unblock,
+	};
+
+	__asm__ volatile(
+		"movq %[args], %%r12\n\t"
+		"movq %[masked], %%r13\n\t"
+		"pushq %%rbp\n\t"
+		"subq $8, %%rsp\n\t"
+		"movq 24(%%r12), %%rbp\n\t"
+		"xorq %%r13, %%rbp\n\t"
+		"xorq %%r13, %%r13\n\t"
+		"movq 0(%%r12), %%rdi\n\t"
+		"movq 8(%%r12), %%rsi\n\t"
+		"call *32(%%r12)\n\t"
+		"movq 16(%%r12), %%rdi\n\t"
+		"call *40(%%r12)\n\t"
+		"movq 0(%%r12), %%rdi\n\t"
+		"movq 8(%%r12), %%rsi\n\t"
+		"call *48(%%r12)\n\t"
+		"movq 24(%%r12), %%rax\n\t"
+		"xorq %%rbp, %%rax\n\t"
+		"addq $8, %%rsp\n\t"
+		"popq %%rbp\n\t"
+		: "=a"(masked)
+		: [args] "r"(args), [masked] "r"(masked)
+		: "rcx", "rdx", "rsi", "rdi", "r8", "r9", "r10", "r11", "r12", "r13",
+			"xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7",
+			"xmm8", "xmm9", "xmm10", "xmm11", "xmm12", "xmm13", "xmm14", "xmm15",
+			"memory", "cc"
+	);
+
+	mutator->obj = (gc_obj_t*)(masked ^ BLOCKED_MASK);
+	ugc_thread_detach(gc, &mutator->thread);
+	return NULL;
+}
+
+static MunitResult
+conservative_blocked(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+	fixture_t* fixture = fixture_;
+	ugc_t* gc = fixture->gc;
+
+	ugc_index_entry_t entries[64];
+	ugc_index_t index;
+	ugc_index_init(&index, entries, 64);
+	gc->index = &index;
+
+	struct conservative_mutator_s mutator = {
+		.gc = gc,
+		.obj = malloc(sizeof(gc_obj_t)),
+	};
+	atomic_init(&mutator.phase, 0);
+	alloc(gc, mutator.obj);
+	munit_assert_int(ugc_index_add(&index, &mutator.obj->header, sizeof(gc_obj_t)), ==, 0);
+
+	pthread_t handle;
+	pthread_create(&handle, NULL, run_blocked_mutator, &mutator);
+	while(atomic_load(&mutator.phase) == 0) { sched_yield(); }
+
+	// The blocked thread does not delay collections
+	for(int i = 0; i < 2; ++i)
+	{
+		ugc_safepoint_begin(gc, NULL);
+		ugc_collect(gc);
+		ugc_safepoint_end(gc);
+	}
+
+	atomic_store(&mutator.phase, 2);
+	pthread_join(handle, NULL);
+	munit_assert_true(mutator.obj->live);
+
+	ugc_release_all(gc);
+	free(mutator.obj);
+
+	return MUNIT_OK;
+}
+
+#endif
+
+#endif
+
+#endif
+
+#if UGC_USE_FIBERS
+
+typedef struct test_fiber_s
+{
+	ugc_fiber_t fiber;
+	gc_obj_t* root;
+	int num_scans;
+} test_fiber_t;
+
+static void
+scan_fiber(ugc_t* gc, ugc_fiber_t* fiber_)
+{
+	test_fiber_t* fiber = (test_fiber_t*)fiber_;
+	++fiber->num_scans;
+	if(fiber->root) { ugc_visit(gc, &fiber->root->header); }
+}
+
+static MunitResult
+fibers(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+	fixture_t* fixture = fixture_;
+	ugc_t* gc = fixture->gc;
+
+	gc_obj_t objs[4];
+	test_fiber_t fibers[3];
+	for(int i = 0; i < 3; ++i)
+	{
+		alloc(gc, &objs[i]);
+		fibers[i] = (test_fiber_t){ .root = &objs[i] };
+		ugc_fiber_add(gc, &fibers[i].fiber, scan_fiber);
+	}
+
+	// Scanned once at the start of the cycle, mark termination skips them
+	ugc_collect(gc);
+	for(int i = 0; i < 3; ++i)
+	{
+		munit_assert_int(fibers[i].num_scans, ==, 1);
+		munit_assert_true(objs[i].live);
+	}
+
+	ugc_step(gc);
+	for(int i = 0; i < 3; ++i) { munit_assert_int(fibers[i].num_scans, ==, 2); }
+
+	// Only the fiber which ran is rescanned
+	ugc_fiber_resume(gc, &fibers[0].fiber);
+	alloc(gc, &objs[3]);
+	fibers[0].root = &objs[3];
+	ugc_fiber_suspend(gc, &fibers[0].fiber);
+
+	ugc_collect(gc);
+	munit_assert_int(fibers[0].num_scans, ==, 3);
+	munit_assert_int(fibers[1].num_scans, ==, 2);
+	munit_assert_int(fibers[2].num_scans, ==, 2);
+	munit_assert_true(objs[3].live);
+
+	ugc_collect(gc);
+	munit_assert_false(objs[0].live);
+	munit_assert_true(objs[3].live);
+
+	// A running fiber is rescanned on every termination attempt
+	ugc_fiber_resume(gc, &fibers[1].fiber);
+	int num_scans = fibers[1].num_scans;
+	int num_terminations = 0;
+	ugc_step(gc);
+	while(gc->state == UGC_MARK)
+	{
+		if(ugc_next(gc->iterator) == gc->to) { ++num_terminations; }
+		ugc_step(gc);
+	}
+	ugc_collect(gc);
+	munit_assert_int(fibers[1].num_scans, ==, num_scans + 1 + num_terminations);
+	munit_assert_int(fibers[2].num_scans, ==, 4);
+
+	ugc_fiber_suspend(gc, &fibers[1].fiber);
+	ugc_fiber_remove(gc, &fibers[1].fiber);
+	ugc_collect(gc);
+	munit_assert_false(objs[1].live);
+	munit_assert_true(objs[2].live);
+
+	ugc_fiber_remove(gc, &fibers[0].fiber);
+	ugc_fiber_remove(gc, &fibers[2].fiber);
+	ugc_collect(gc);
+	munit_assert_false(objs[2].live);
+	munit_assert_false(objs[3].live);
+
+	return MUNIT_OK;
+}
+
+#endif
+
+#if UGC_USE_PINS
+
+static MunitResult
+pins(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+	fixture_t* fixture = fixture_;
+	ugc_t* gc = fixture->gc;
+
+	uintptr_t slots[5];
+	ugc_pins_init(gc, slots, 5);
+
+	gc_obj_t objs[8];
+	for(int i = 0; i < 8; ++i) { alloc(gc, &objs[i]); }
+
+	munit_assert_size(ugc_pin(gc, &objs[0].header), ==, 0);
+	munit_assert_size(ugc_pin(gc, &objs[1].header), ==, 1);
+	munit_assert_size(ugc_pin(gc, &objs[2].header), ==, 2);
+	ugc_unpin(gc, 1);
+
+	// Free slots are reused first
+	munit_assert_size(ugc_pin(gc, &objs[3].header), ==, 1);
+	munit_assert_ptr_equal(ugc_pinned(gc, 1), &objs[3].header);
+	munit_assert_size(ugc_pin(gc, &objs[4].header), ==, 3);
+	munit_assert_size(ugc_pin(gc, &objs[5].header), ==, 4);
+	munit_assert_size(ugc_pin(gc, &objs[6].header), ==, SIZE_MAX);
+
+	// The root scan only covers the first chunk of the table
+	ugc_step(gc);
+	munit_assert_int(ugc_color(&objs[0].header), !=, gc->white);
+	munit_assert_int(ugc_color(&objs[3].header), !=, gc->white);
+	munit_assert_int(ugc_color(&objs[2].header), ==, gc->white);
+	munit_assert_int(ugc_color(&objs[4].header), ==, gc->white);
+
+	// Pinning after the table was scanned grays the object
+	while(gc->pin_cursor < 5) { ugc_step(gc); }
+	ugc_unpin(gc, 0);
+	munit_assert_size(ugc_pin(gc, &objs[7].header), ==, 0);
+	munit_assert_int(ugc_color(&objs[7].header), ==, UGC_GRAY);
+
+	ugc_collect(gc);
+	munit_assert_true(objs[0].live);
+	munit_assert_false(objs[1].live);
+	for(int i = 2; i < 6; ++i) { munit_assert_true(objs[i].live); }
+	munit_assert_false(objs[6].live);
+	munit_assert_true(objs[7].live);
+
+	ugc_collect(gc);
+	munit_assert_false(objs[0].live);
+
+	// A full collection scans the whole table at once
+	ugc_unpin(gc, 2);
+	ugc_collect_full(gc);
+	munit_assert_false(objs[2].live);
+	munit_assert_true(objs[3].live);
+	munit_assert_true(objs[5].live);
+
+	for(size_t i = 0; i < 5; ++i)
+	{
+		if(i != 2) { ugc_unpin(gc, i); }
+	}
+	ugc_collect(gc);
+	for(int i = 0; i < 8; ++i) { munit_assert_false(objs[i].live); }
+
+	return MUNIT_OK;
+}
+
+#endif
+
+#if UGC_USE_WEAK
+
+static struct
+{
+	ugc_weak_t weak;
+	ugc_header_t* refs[3];
+	ugc_weak_t ephemerons;
+	ugc_header_t* keys[3];
+	ugc_header_t* values[3];
+} weak_roots;
+
+static void
+scan_weak(ugc_t* gc, ugc_header_t* obj)
+{
+	scan_gc_obj(gc, obj);
+
+	if(obj == NULL)
+	{
+		ugc_visit_weak(gc, &weak_roots.weak);
+		ugc_visit_weak(gc, &weak_roots.ephemerons);
+	}
+}
+
+static void
+reset_weak_roots(gc_obj_t* objs)
+{
+	ugc_weak_init(&weak_roots.weak, weak_roots.refs, NULL, 3);
+	weak_roots.refs[0] = &objs[1].header;
+	weak_roots.refs[1] = &objs[2].header;
+	weak_roots.refs[2] = NULL;
+
+	// Each value is only reachable through its key. The first entry can only
+	// be marked after the last one.
+	ugc_weak_init(&weak_roots.ephemerons, weak_roots.keys, weak_roots.values, 3);
+	weak_roots.keys[0] = &objs[4].header;
+	weak_roots.values[0] = &objs[6].header;
+	weak_roots.keys[1] = &objs[3].header;
+	weak_roots.values[1] = &objs[5].header;
+	weak_roots.keys[2] = &objs[1].header;
+	weak_roots.values[2] = &objs[4].header;
+}
+
+static MunitResult
+weak(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+	fixture_t* fixture = fixture_;
+	ugc_t* gc = fixture->gc;
+	gc->scan_fn = scan_weak;
+
+	gc_obj_t objs[7];
+	for(int i = 0; i < 7; ++i) { alloc(gc, &objs[i]); }
+	fixture->root = &objs[0];
+	set_ref(gc, &objs[0], &objs[1]);
+	// A value referring to its key does not keep the entry alive
+	set_ref(gc, &objs[5], &objs[3]);
+	reset_weak_roots(objs);
+
+	ugc_collect(gc);
+	munit_assert_true(objs[1].live);
+	munit_assert_false(objs[2].live);
+	munit_assert_false(objs[3].live);
+	munit_assert_true(objs[4].live);
+	munit_assert_false(objs[5].live);
+	munit_assert_true(objs[6].live);
+
+	munit_assert_ptr_equal(weak_roots.refs[0], &objs[1].header);
+	munit_assert_null(weak_roots.refs[1]);
+	munit_assert_null(weak_roots.refs[2]);
+	munit_assert_size(weak_roots.weak.num_cleared, ==, 1);
+	munit_assert_ptr_equal(weak_roots.values[0], &objs[6].header);
+	munit_assert_null(weak_roots.keys[1]);
+	munit_assert_null(weak_roots.values[1]);
+	munit_assert_ptr_equal(weak_roots.values[2], &objs[4].header);
+	munit_assert_size(weak_roots.ephemerons.num_cleared, ==, 1);
+
+	// Abandoning a mark phase forgets the visited containers
+	ugc_step(gc);
+	ugc_step(gc);
+	munit_assert_int(gc->state, ==, UGC_MARK);
+	set_ref(gc, &objs[0], NULL);
+	ugc_collect_full(gc);
+	munit_assert_true(objs[0].live);
+	munit_assert_false(objs[1].live);
+	munit_assert_false(objs[4].live);
+	munit_assert_false(objs[6].live);
+	munit_assert_null(weak_roots.refs[0]);
+	munit_assert_null(weak_roots.keys[0]);
+	munit_assert_null(weak_roots.values[0]);
+	munit_assert_null(weak_roots.keys[2]);
+	munit_assert_null(weak_roots.values[2]);
+	munit_assert_size(weak_roots.ephemerons.num_cleared, ==, 3);
+
+	// A full collection also iterates ephemerons to a fixpoint
+	for(int i = 1; i < 7; ++i) { alloc(gc, &objs[i]); }
+	set_ref(gc, &objs[0], &objs[1]);
+	reset_weak_roots(objs);
+	ugc_collect_full(gc);
+	for(int i = 0; i < 7; ++i)
+	{
+		munit_assert_true(objs[i].live == (i == 0 || i == 1 || i == 4 || i == 6));
+	}
+
+	fixture->root = NULL;
+	ugc_collect(gc);
+	munit_assert_null(weak_roots.refs[0]);
+	munit_assert_null(weak_roots.keys[2]);
+
+	return MUNIT_OK;
+}
+
+#endif
+
+#if UGC_USE_LARGE
+
+typedef struct large_obj_s
+{
+	ugc_large_t large;
+	struct large_obj_s* ref;
+	bool live;
+} large_obj_t;
+
+static large_obj_t* large_root;
+
+static void
+scan_large(ugc_t* gc, ugc_header_t* header)
+{
+	large_obj_t* ref = header != NULL ? ((large_obj_t*)header)->ref : large_root;
+	if(ref) { ugc_visit(gc, &ref->large.header); }
+}
+
+static void
+release_large(ugc_t* gc, ugc_header_t* header)
+{
+	(void)gc;
+	large_obj_t* obj = (large_obj_t*)header;
+	munit_assert_true(obj->live);
+	obj->live = false;
+}
+
+static void
+alloc_large(ugc_t* gc, large_obj_t* obj, size_t size)
+{
+	obj->live = true;
+	obj->ref = NULL;
+	ugc_register_large(gc, &obj->large, size);
+}
+
+static MunitResult
+large(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+	fixture_t* fixture = fixture_;
+	ugc_t* gc = fixture->gc;
+	gc->scan_fn = scan_large;
+	gc->release_fn = release_large;
+
+	large_obj_t objs[4];
+	alloc_large(gc, &objs[0], 1000);
+	alloc_large(gc, &objs[1], 2000);
+	alloc_large(gc, &objs[2], 3000);
+	large_root = &objs[0];
+	objs[0].ref = &objs[1];
+	munit_assert_size(gc->large_size, ==, 6000);
+
+	// Garbage is released before the first sweep step
+	while(gc->state != UGC_SWEEP) { ugc_step(gc); }
+	munit_assert_false(objs[2].live);
+	munit_assert_size(gc->large_size, ==, 3000);
+	munit_assert_size(gc->large_registered, ==, 0);
+	ugc_collect(gc);
+	munit_assert_true(objs[0].live);
+	munit_assert_true(objs[1].live);
+
+	objs[0].ref = NULL;
+	ugc_collect_full(gc);
+	munit_assert_false(objs[1].live);
+	munit_assert_size(gc->large_size, ==, 1000);
+
+#if UGC_USE_PACER
+	// Registering enough large objects starts a cycle even without credit
+	gc->large_trigger = 4096;
+	gc->pace_credit = -1000000;
+	fake_clock = 1;
+	alloc_large(gc, &objs[2], 4000);
+	ugc_pace(gc);
+	munit_assert_int(gc->state, ==, UGC_IDLE);
+	munit_assert_true(objs[2].live);
+
+	alloc_large(gc, &objs[3], 100);
+	munit_assert_size(gc->large_registered, ==, 4100);
+	large_root = NULL;
+	ugc_pace(gc);
+	munit_assert_int(gc->state, ==, UGC_MARK);
+	ugc_collect(gc);
+	munit_assert_false(objs[0].live);
+	munit_assert_false(objs[2].live);
+	munit_assert_false(objs[3].live);
+	munit_assert_size(gc->large_size, ==, 0);
+	fake_clock = 0;
+#endif
+
+	large_root = NULL;
+	ugc_collect(gc);
+	munit_assert_false(objs[0].live);
+	munit_assert_size(gc->large_size, ==, 0);
+
+	return MUNIT_OK;
+}
+
+#endif
+
+#if UGC_USE_REGIONS
+
+static void
+alloc_region(ugc_t* gc, gc_obj_t* obj, gc_obj_t* ref)
+{
+	obj->live = true;
+	obj->ref = ref;
+	ugc_register_region(gc, &obj->header);
+}
+
+#if UGC_USE_WEAK
+
+typedef struct region_weak_s
+{
+	gc_obj_t obj;
+	ugc_weak_t weak;
+	ugc_header_t* refs[1];
+} region_weak_t;
+
+static region_weak_t* region_weak;
+
+static void
+scan_region_weak(ugc_t* gc, ugc_header_t* obj)
+{
+	if(obj != NULL && region_weak != NULL && obj == &region_weak->obj.header)
+	{
+		ugc_visit_weak(gc, &region_weak->weak);
+	}
+
+	scan_gc_obj(gc, obj);
+}
+
+static void
+release_region_weak(ugc_t* gc, ugc_header_t* obj)
+{
+	if(region_weak != NULL && obj == &region_weak->obj.header)
+	{
+		free(region_weak);
+		region_weak = NULL;
+		return;
+	}
+
+	free_gc_obj(gc, obj);
+}
+
+#endif
+
+static MunitResult
+regions(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+	fixture_t* fixture = fixture_;
+	ugc_t* gc = fixture->gc;
+
+	gc_obj_t heap_objs[4];
+	for(int i = 0; i < 4; ++i) { alloc(gc, &heap_objs[i]); }
+	fixture->root = &heap_objs[0];
+
+	// Objects referenced by the region are kept alive
+	ugc_region_t region;
+	gc_obj_t objs[4];
+	ugc_region_open(gc, &region);
+	alloc_region(gc, &objs[0], &heap_objs[1]);
+	alloc_region(gc, &objs[1], NULL);
+	alloc_region(gc, &objs[2], NULL);
+	set_ref(gc, &objs[1], &objs[2]);
+	ugc_collect(gc);
+	munit_assert_true(heap_objs[1].live);
+	for(int i = 0; i < 3; ++i) { munit_assert_true(objs[i].live); }
+
+	// Objects registered or modified during the mark phase are black
+	ugc_step(gc);
+	munit_assert_int(gc->state, ==, UGC_MARK);
+	alloc(gc, &heap_objs[2]);
+	alloc_region(gc, &objs[3], &heap_objs[2]);
+	alloc(gc, &heap_objs[3]);
+	set_ref(gc, &objs[1], &heap_objs[3]);
+	ugc_collect(gc);
+	munit_assert_true(heap_objs[2].live);
+	munit_assert_true(heap_objs[3].live);
+
+	munit_assert_size(region.num_escapes, ==, 0);
+	munit_assert_int(ugc_region_close(gc), ==, 1);
+	for(int i = 0; i < 4; ++i) { munit_assert_false(objs[i].live); }
+	ugc_collect(gc);
+	munit_assert_false(heap_objs[1].live);
+	munit_assert_false(heap_objs[2].live);
+	munit_assert_false(heap_objs[3].live);
+
+	// Escaped objects are collected like any other
+	ugc_region_open(gc, &region);
+	alloc_region(gc, &objs[0], NULL);
+	alloc_region(gc, &objs[1], NULL);
+	alloc_region(gc, &objs[2], &objs[1]);
+	set_ref(gc, &heap_objs[0], &objs[2]);
+	munit_assert_size(region.num_escapes, ==, 1);
+	ugc_step(gc);
+	munit_assert_int(ugc_region_close(gc), ==, 0);
+	ugc_collect(gc);
+	munit_assert_true(objs[0].live);
+	ugc_collect(gc);
+	munit_assert_false(objs[0].live);
+	munit_assert_true(objs[1].live);
+	munit_assert_true(objs[2].live);
+
+	fixture->root = NULL;
+	ugc_collect(gc);
+	munit_assert_false(objs[1].live);
+	munit_assert_false(objs[2].live);
+
+#if UGC_USE_WEAK
+	// A container visited by the root scan stays in use until the end of the
+	// mark phase
+	gc->scan_fn = scan_region_weak;
+	gc->release_fn = release_region_weak;
+	region_weak = malloc(sizeof(region_weak_t));
+	ugc_weak_init(&region_weak->weak, region_weak->refs, NULL, 1);
+	region_weak->refs[0] = &heap_objs[0].header;
+
+	ugc_region_open(gc, &region);
+	alloc_region(gc, &region_weak->obj, NULL);
+	ugc_step(gc);
+	munit_assert_int(gc->state, ==, UGC_MARK);
+	munit_assert_size(region.num_escapes, ==, 0);
+	munit_assert_int(ugc_region_close(gc), ==, 0);
+	munit_assert_not_null(region_weak);
+
+	ugc_collect(gc);
+	ugc_collect(gc);
+	munit_assert_null(region_weak);
+	gc->scan_fn = scan_gc_obj;
+	gc->release_fn = free_gc_obj;
+#endif
+
+	return MUNIT_OK;
+}
+
+#endif
+
+#if UGC_USE_FINALIZERS
+
+typedef struct final_obj_s
+{
+	ugc_finalizable_t fin;
+	struct final_obj_s* ref;
+	bool live;
+	bool finalized;
+} final_obj_t;
+
+static final_obj_t* final_root;
+
+static void
+scan_final(ugc_t* gc, ugc_header_t* header)
+{
+	final_obj_t* ref = header != NULL ? ((final_obj_t*)header)->ref : final_root;
+	if(ref) { ugc_visit(gc, &ref->fin.header); }
+}
+
+static void
+release_final(ugc_t* gc, ugc_header_t* header)
+{
+	(void)gc;
+	final_obj_t* obj = (final_obj_t*)header;
+	munit_assert_true(obj->live);
+	obj->live = false;
+}
+
+static void
+finalize_final(ugc_t* gc, ugc_header_t* header)
+{
+	(void)gc;
+	final_obj_t* obj = (final_obj_t*)header;
+	munit_assert_true(obj->live);
+	munit_assert_false(obj->finalized);
+	obj->finalized = true;
+}
+
+static void
+alloc_final(ugc_t* gc, final_obj_t* obj, bool finalizable)
+{
+	obj->live = true;
+	obj->finalized = false;
+	obj->ref = NULL;
+	if(finalizable)
+	{
+		ugc_register_finalizable(gc, &obj->fin);
+	}
+	else
+	{
+		ugc_register(gc, &obj->fin.header);
+	}
+}
+
+static MunitResult
+finalizers(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+	fixture_t* fixture = fixture_;
+	ugc_t* gc = fixture->gc;
+	gc->scan_fn = scan_final;
+	gc->release_fn = release_final;
+	gc->finalize_fn = finalize_final;
+
+	final_obj_t objs[4];
+	alloc_final(gc, &objs[0], true);
+	alloc_final(gc, &objs[1], true);
+	alloc_final(gc, &objs[2], false);
+	final_root = &objs[0];
+	objs[1].ref = &objs[2];
+
+	// Garbage is queued along with everything it refers to
+	ugc_collect(gc);
+	munit_assert_size(gc->num_finalizers, ==, 1);
+	for(int i = 0; i < 3; ++i) { munit_assert_true(objs[i].live); }
+	ugc_collect(gc);
+	munit_assert_true(objs[1].live);
+	munit_assert_true(objs[2].live);
+	munit_assert_false(objs[1].finalized);
+
+	// Finalized objects are ordinary ones
+	munit_assert_size(ugc_finalize(gc, 0), ==, 0);
+	munit_assert_size(ugc_finalize(gc, 10), ==, 1);
+	munit_assert_true(objs[1].finalized);
+	munit_assert_size(gc->num_finalizers, ==, 0);
+	munit_assert_size(ugc_finalize(gc, 10), ==, 0);
+	ugc_collect(gc);
+	munit_assert_false(objs[1].live);
+	munit_assert_false(objs[2].live);
+	munit_assert_true(objs[0].live);
+
+	// Objects can be resurrected by their finalizer
+	alloc_final(gc, &objs[3], true);
+	final_root = NULL;
+	ugc_collect_full(gc);
+	munit_assert_size(gc->num_finalizers, ==, 2);
+	munit_assert_size(ugc_finalize(gc, 1), ==, 1);
+	munit_assert_true(objs[0].finalized);
+	final_root = &objs[0];
+	munit_assert_size(ugc_finalize(gc, 1), ==, 1);
+	munit_assert_true(objs[3].finalized);
+	ugc_collect(gc);
+	munit_assert_true(objs[0].live);
+	munit_assert_false(objs[3].live);
+
+	// Objects are finalized at most once
+	final_root = NULL;
+	alloc_final(gc, &objs[1], true);
+	ugc_collect(gc);
+	munit_assert_false(objs[0].live);
+	munit_assert_size(gc->num_finalizers, ==, 1);
+
+	// Queued objects are released without being finalized
+	ugc_release_all(gc);
+	munit_assert_false(objs[1].live);
+	munit_assert_false(objs[1].finalized);
+	munit_assert_size(gc->num_finalizers, ==, 0);
+
+	return MUNIT_OK;
+}
+
+#endif
+
+#if UGC_USE_EVACUATION
+
+#define PAGE_SIZE 4
+
+#if UGC_USE_WEAK
+typedef struct weak_holder_s
+{
+	ugc_header_t header;
+	ugc_weak_t weak;
+	ugc_header_t* refs[2];
+	bool live;
+} weak_holder_t;
+#endif
+
+// Objects are evacuated from the sparse page to the fresh one
+static struct
+{
+	gc_obj_t sparse[PAGE_SIZE];
+	gc_obj_t fresh[PAGE_SIZE];
+	size_t num_live;
+	size_t num_moved;
+#if UGC_USE_WEAK
+	// The first holder is moved to the second one when requested
+	weak_holder_t holders[2];
+	weak_holder_t* holder_root;
+	bool move_holder;
+#endif
+} pages;
+
+#if UGC_USE_WEAK
+static weak_holder_t*
+as_holder(ugc_header_t* obj)
+{
+	for(int i = 0; i < 2; ++i)
+	{
+		if(obj == &pages.holders[i].header) { return &pages.holders[i]; }
+	}
+
+	return NULL;
+}
+#endif
+
+static bool
+in_sparse_page(ugc_header_t* obj)
+{
+	return (gc_obj_t*)obj >= pages.sparse && (gc_obj_t*)obj < pages.sparse + PAGE_SIZE;
+}
+
+static void
+scan_paged(ugc_t* gc, ugc_header_t* obj)
+{
+#if UGC_USE_WEAK
+	weak_holder_t* holder = obj != NULL ? as_holder(obj) : pages.holder_root;
+	if(holder != NULL) { ugc_visit(gc, &holder->header); }
+	if(obj != NULL && holder != NULL)
+	{
+		ugc_visit_weak(gc, &holder->weak);
+		return;
+	}
+#endif
+
+	// Each live object is scanned once per cycle
+	if(obj != NULL && in_sparse_page(obj)) { ++pages.num_live; }
+	scan_gc_obj(gc, obj);
+}
+
+static void
+release_paged(ugc_t* gc, ugc_header_t* obj)
+{
+#if UGC_USE_WEAK
+	weak_holder_t* holder = as_holder(obj);
+	if(holder != NULL)
+	{
+		munit_assert_true(holder->live);
+		holder->live = false;
+		return;
+	}
+#endif
+
+	free_gc_obj(gc, obj);
+}
+
+static ugc_header_t*
+evacuate_paged(ugc_t* gc, ugc_header_t* obj)
+{
+	(void)gc;
+#if UGC_USE_WEAK
+	if(obj == &pages.holders[0].header && pages.move_holder)
+	{
+		weak_holder_t* copy = &pages.holders[1];
+		*copy = pages.holders[0];
+		copy->weak.refs = copy->refs;
+		return &copy->header;
+	}
+#endif
+
+	if(!in_sparse_page(obj) || pages.num_live * 2 > PAGE_SIZE) { return NULL; }
+
+	gc_obj_t* copy = &pages.fresh[pages.num_moved++];
+	*copy = *(gc_obj_t*)obj;
+	return &copy->header;
+}
+
+static void
+relocate_paged(ugc_t* gc, ugc_header_t* obj)
+{
+#if UGC_USE_WEAK
+	weak_holder_t* holder = obj != NULL ? as_holder(obj) : NULL;
+	if(holder != NULL)
+	{
+		for(int i = 0; i < 2; ++i)
+		{
+			if(holder->refs[i]) { holder->refs[i] = ugc_forward(gc, holder->refs[i]); }
+		}
+		return;
+	}
+
+	if(obj == NULL && pages.holder_root != NULL)
+	{
+		pages.holder_root = (weak_holder_t*)ugc_forward(gc, &pages.holder_root->header);
+	}
+#endif
+
+	if(obj != NULL)
+	{
+		gc_obj_t* ref = ((gc_obj_t*)obj)->ref;
+		if(ref) { ((gc_obj_t*)obj)->ref = (gc_obj_t*)ugc_forward(gc, &ref->header); }
+	}
+	else
+	{
+		fixture_t* fixture = gc->userdata;
+		if(fixture->root)
+		{
+			fixture->root = (gc_obj_t*)ugc_forward(gc, &fixture->root->header);
+		}
+	}
+}
+
+static MunitResult
+evacuation(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+	fixture_t* fixture = fixture_;
+	ugc_t* gc = fixture->gc;
+	gc->scan_fn = scan_paged;
+	gc->release_fn = release_paged;
+	gc->evacuate_fn = evacuate_paged;
+	gc->relocate_fn = relocate_paged;
+	pages.num_moved = 0;
+#if UGC_USE_WEAK
+	pages.holder_root = NULL;
+	pages.move_holder = false;
+#endif
+
+	gc_obj_t* objs = pages.sparse;
+	for(int i = 0; i < PAGE_SIZE; ++i) { alloc(gc, &objs[i]); }
+	fixture->root = &objs[0];
+	set_ref(gc, &objs[0], &objs[1]);
+	set_ref(gc, &objs[1], &objs[2]);
+
+	// Nothing is moved while the page is dense enough
+	pages.num_live = 0;
+	ugc_collect(gc);
+	munit_assert_size(gc->num_evacuated, ==, 0);
+	munit_assert_false(objs[3].live);
+
+#if UGC_USE_PINS
+	uintptr_t pin_slots[2];
+	ugc_pins_init(gc, pin_slots, 2);
+	size_t slot = ugc_pin(gc, &objs[2].header);
+#endif
+
+	set_ref(gc, &objs[0], &objs[2]);
+	pages.num_live = 0;
+	ugc_collect(gc);
+	munit_assert_size(gc->num_evacuated, ==, 2);
+	munit_assert_false(objs[1].live);
+
+	// References to the originals were replaced
+	gc_obj_t* fresh = pages.fresh;
+	munit_assert_ptr_equal(fixture->root, &fresh[0]);
+	munit_assert_ptr_equal(fresh[0].ref, &fresh[1]);
+#if UGC_USE_PINS
+	munit_assert_ptr_equal(ugc_pinned(gc, slot), &fresh[1].header);
+	ugc_unpin(gc, slot);
+#endif
+
+	// Copies are collected like any other object
+	pages.num_live = 0;
+	ugc_collect(gc);
+	munit_assert_size(gc->num_evacuated, ==, 0);
+	munit_assert_true(fresh[1].live);
+
+	fixture->root = NULL;
+	ugc_collect(gc);
+	munit_assert_false(fresh[0].live);
+	munit_assert_false(fresh[1].live);
+
+#if UGC_USE_WEAK
+	// Weak containers are cleared before they move with their owner
+	weak_holder_t* holders = pages.holders;
+	alloc(gc, &fresh[2]);
+	alloc(gc, &fresh[3]);
+	holders[0].live = true;
+	ugc_register(gc, &holders[0].header);
+	ugc_weak_init(&holders[0].weak, holders[0].refs, NULL, 2);
+	holders[0].refs[0] = &fresh[2].header;
+	holders[0].refs[1] = &fresh[3].header;
+	pages.holder_root = &holders[0];
+	fixture->root = &fresh[3];
+	pages.move_holder = true;
+	ugc_collect(gc);
+	munit_assert_size(gc->num_evacuated, ==, 1);
+	munit_assert_ptr_equal(pages.holder_root, &holders[1]);
+	munit_assert_null(holders[1].refs[0]);
+	munit_assert_ptr_equal(holders[1].refs[1], &fresh[3].header);
+	munit_assert_null(holders[1].weak.next);
+
+	// The copy is visited by later cycles
+	pages.move_holder = false;
+	fixture->root = NULL;
+	ugc_collect(gc);
+	munit_assert_false(fresh[3].live);
+	munit_assert_null(holders[1].refs[1]);
+
+	pages.holder_root = NULL;
+	ugc_collect(gc);
+	munit_assert_false(holders[1].live);
+	munit_assert_true(holders[0].live);
+#endif
+
+	return MUNIT_OK;
+}
+
+#endif
+
+#if UGC_USE_SORT
+
+#define NUM_SORTED 37
+
+// Return the number of objects in address order at the start of a list
+static size_t
+count_sorted(ugc_header_t* list)
+{
+	size_t count = 0;
+	for(ugc_header_t* itr = ugc_next(list); itr != list; itr = ugc_next(itr))
+	{
+		++count;
+		if(ugc_next(itr) == list || (uintptr_t)ugc_next(itr) < (uintptr_t)itr) { break; }
+	}
+
+	return count;
+}
+
+static MunitResult
+sort(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+	fixture_t* fixture = fixture_;
+	ugc_t* gc = fixture->gc;
+	gc->sort_period = 2;
+
+	// Survivors are scanned in a scrambled order and interleaved with garbage
+	gc_obj_t objs[NUM_SORTED];
+	gc_obj_t garbage[NUM_SORTED];
+	for(int i = NUM_SORTED - 1; i >= 0; --i)
+	{
+		alloc(gc, &objs[i]);
+		alloc(gc, &garbage[i]);
+	}
+	for(int i = 0; i < NUM_SORTED - 1; ++i)
+	{
+		objs[i * 17 % NUM_SORTED].ref = &objs[(i + 1) * 17 % NUM_SORTED];
+	}
+	fixture->root = &objs[0];
+
+	ugc_collect(gc);
+	munit_assert_size(count_sorted(gc->from), <, NUM_SORTED);
+	for(int i = 0; i < NUM_SORTED; ++i) { munit_assert_false(garbage[i].live); }
+
+	// Objects registered during the sort are kept after the sorted ones
+	while(gc->state != UGC_SWEEP) { ugc_step(gc); }
+	gc_obj_t extra[2];
+	alloc(gc, &extra[0]);
+	ugc_step(gc);
+	alloc(gc, &extra[1]);
+	ugc_collect(gc);
+	munit_assert_size(count_sorted(gc->from), ==, NUM_SORTED);
+	munit_assert_ptr_equal(ugc_prev(gc->from), &extra[1].header);
+	munit_assert_ptr_equal(ugc_prev(ugc_prev(gc->from)), &extra[0].header);
+
+	// The mark phase scrambles the order again
+	ugc_collect(gc);
+	munit_assert_size(count_sorted(gc->from), <, NUM_SORTED);
+	munit_assert_false(extra[0].live);
+	munit_assert_false(extra[1].live);
+
+	// A sort in progress is abandoned by a full collection
+	while(gc->state != UGC_SWEEP) { ugc_step(gc); }
+	munit_assert_size(gc->sort_width, !=, 0);
+	ugc_collect_full(gc);
+	munit_assert_size(gc->sort_width, ==, 0);
+	for(int i = 0; i < NUM_SORTED; ++i) { munit_assert_true(objs[i].live); }
+
+	fixture->root = NULL;
+	ugc_collect(gc);
+	for(int i = 0; i < NUM_SORTED; ++i) { munit_assert_false(objs[i].live); }
+
+	return MUNIT_OK;
+}
+
+#endif
+
+#if UGC_USE_TRACE
+
+static size_t
+count_substr(const char* str, const char* substr)
+{
+	size_t count = 0;
+	while((str = strstr(str, substr)) != NULL)
+	{
+		++count;
+		++str;
+	}
+
+	return count;
+}
+
+static MunitResult
+trace(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+	fixture_t* fixture = fixture_;
+	ugc_t* gc = fixture->gc;
+
+	ugc_trace_event_t events[16];
+	ugc_trace_init(gc, events, 16);
+	gc->trace_threshold = 0;
+
+	gc_obj_t a, b;
+
+	alloc(gc, &a);
+	alloc(gc, &b);
+	fixture->root = &a;
+
+	while(ugc_color(&a.header) != !gc->white) { ugc_step(gc); }
+	set_ref(gc, &a, &b);
+	ugc_collect(gc);
+
+	buffer_t buf = { .size = 0 };
+	ugc_trace_dump(gc, write_buffer, &buf);
+
+	munit_assert_true(strncmp(buf.data, "{\"traceEvents\":[", 16) == 0);
+	munit_assert_size(count_substr(buf.data, "\"name\":\"cycle\",\"cat\":\"gc\",\"ph\":\"B\""), ==, 1);
+	munit_assert_size(count_substr(buf.data, "\"name\":\"cycle\",\"cat\":\"gc\",\"ph\":\"E\""), ==, 1);
+	munit_assert_size(count_substr(buf.data, "\"name\":\"mark\""), ==, 2);
+	munit_assert_size(count_substr(buf.data, "\"name\":\"sweep\""), ==, 2);
+	munit_assert_size(count_substr(buf.data, "\"name\":\"barrier\""), ==, 1);
+	munit_assert_size(count_substr(buf.data, "\"dur\":"), >, 0);
+
+	// Only the most recent events are kept
+	for(int i = 0; i < 4; ++i) { ugc_collect_full(gc); }
+
+	buf.size = 0;
+	ugc_trace_dump(gc, write_buffer, &buf);
+	munit_assert_size(count_substr(buf.data, "\"name\":"), ==, 16);
+	munit_assert_size(count_substr(buf.data, "\"name\":\"collect_full\""), ==, 4);
+
+	// An abandoned mark phase is closed
+	ugc_trace_init(gc, events, 16);
+	while(gc->state != UGC_MARK) { ugc_step(gc); }
+	ugc_collect_full(gc);
+
+	buf.size = 0;
+	ugc_trace_dump(gc, write_buffer, &buf);
+	munit_assert_size(count_substr(buf.data, "\"name\":\"cycle\",\"cat\":\"gc\",\"ph\":\"B\""), ==, 1);
+	munit_assert_size(count_substr(buf.data, "\"name\":\"cycle\",\"cat\":\"gc\",\"ph\":\"E\""), ==, 1);
+	munit_assert_size(count_substr(buf.data, "\"name\":\"mark\",\"cat\":\"gc\",\"ph\":\"E\""), ==, 1);
+
+	ugc_trace_init(gc, NULL, 0);
+	ugc_collect(gc);
+
+	return MUNIT_OK;
+}
+
+#endif
+
+static MunitResult
+register_chain(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+	fixture_t* fixture = fixture_;
+	ugc_t* gc = fixture->gc;
+
+	gc_obj_t a, b, c, d, e;
+	ugc_header_t chain;
+
+	alloc(gc, &a);
+	fixture->root = &a;
+
+	for(int state = UGC_IDLE; state <= UGC_SWEEP; ++state)
+	{
+		ugc_chain_init(gc, &chain);
+
+		// Let the colors go out of date
+		ugc_collect(gc);
+		while(gc->state != state) { ugc_step(gc); }
+
+		gc_obj_t* objs[] = { &b, &c, &d, &e };
+		for(int i = 0; i < 4; ++i)
+		{
+			objs[i]->live = true;
+			objs[i]->ref = NULL;
+			ugc_chain_push(&chain, &objs[i]->header);
+		}
+		b.ref = &c;
+		c.ref = &d;
+
+		ugc_register_chain(gc, &chain);
+		set_ref(gc, &a, &b);
+
+		ugc_collect(gc);
+		ugc_collect(gc);
+
+		munit_assert_true(a.live);
+		munit_assert_true(b.live);
+		munit_assert_true(c.live);
+		munit_assert_true(d.live);
+		munit_assert_true(!e.live);
+
+		set_ref(gc, &a, NULL);
+		ugc_collect(gc);
+		ugc_collect(gc);
+
+		munit_assert_true(!b.live);
+		munit_assert_true(!c.live);
+		munit_assert_true(!d.live);
+	}
+
+	return MUNIT_OK;
+}
+
+static MunitResult
+merge(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+	fixture_t* fixture = fixture_;
+	ugc_t* gc = fixture->gc;
+
+	for(int src_state = UGC_IDLE; src_state <= UGC_SWEEP; ++src_state)
+	{
+		for(int dst_state = UGC_IDLE; dst_state <= UGC_SWEEP; ++dst_state)
+		{
+			for(int flip = 0; flip < 2; ++flip)
+			{
+				gc_obj_t a, b, c, d, e;
+				fixture_t src_fixture = { .root = &c };
+				ugc_t src;
+				ugc_init(&src, scan_gc_obj, free_gc_obj);
+				src.userdata = &src_fixture;
+
+				alloc(gc, &a);
+				fixture->root = &a;
+				alloc(&src, &b);
+				alloc(&src, &c);
+				alloc(&src, &d);
+				set_ref(&src, &c, &d);
+
+				if(flip) { ugc_collect(&src); }
+				while(src.state != src_state) { ugc_step(&src); }
+				while(gc->state != dst_state) { ugc_step(gc); }
+
+				alloc(&src, &e);
+				ugc_merge(gc, &src);
+				munit_assert_int(src.state, ==, UGC_IDLE);
+
+				set_ref(gc, &a, &c);
+				ugc_collect(gc);
+				ugc_collect(gc);
+				ugc_collect(gc);
+
+				munit_assert_true(a.live);
+				munit_assert_true(c.live);
+				munit_assert_true(d.live);
+				munit_assert_true(!e.live);
+				// b is garbage whether it was swept by src or by gc
+				munit_assert_true(!b.live);
+
+				fixture->root = NULL;
+				ugc_collect(gc);
+				ugc_collect(gc);
+				munit_assert_true(!a.live);
+				munit_assert_true(!c.live);
+				munit_assert_true(!d.live);
+			}
+		}
+	}
+
+#if UGC_USE_CONSERVATIVE
+	// Indexed objects are found through the index of dst
+	ugc_index_entry_t src_entries[16], dst_entries[16];
+	ugc_index_t src_index, dst_index;
+	ugc_index_init(&src_index, src_entries, 16);
+	ugc_index_init(&dst_index, dst_entries, 16);
+	gc->index = &dst_index;
+
+	ugc_t src;
+	ugc_init(&src, scan_gc_obj, free_gc_obj);
+	src.index = &src_index;
+
+	gc_obj_t a, b;
+	alloc(&src, &a);
+	alloc(&src, &b);
+	munit_assert_int(ugc_index_add(&src_index, &a.header, sizeof(gc_obj_t)), ==, 0);
+	munit_assert_int(ugc_index_add(&src_index, &b.header, sizeof(gc_obj_t)), ==, 0);
+	size_t num_entries = src_index.num_entries;
+
+	ugc_merge(gc, &src);
+	munit_assert_size(src_index.num_entries, ==, 0);
+	munit_assert_size(dst_index.num_entries, ==, num_entries);
+	munit_assert_ptr_equal(ugc_index_find(&dst_index, &a.ref), &a.header);
+	munit_assert_ptr_equal(ugc_index_find(&dst_index, &b.ref), &b.header);
+
+	// They are removed from it when released
+	ugc_collect(gc);
+	ugc_collect(gc);
+	munit_assert_true(!a.live);
+	munit_assert_true(!b.live);
+	munit_assert_size(dst_index.num_entries, ==, 0);
+	gc->index = NULL;
+#endif
+
+	return MUNIT_OK;
+}
+
+#if UGC_USE_THREADS
+
+#define MUTATOR_NUM_THREADS 4
+#define MUTATOR_NUM_OBJS 2000
+
+struct mutator_s
+{
+	ugc_t* gc;
+	ugc_thread_t thread;
+	gc_obj_t* root;
+	gc_obj_t objs[MUTATOR_NUM_OBJS];
+	bool local;
+	atomic_bool done;
+	atomic_bool* finish;
+};
+
+static void
+scan_mutator(ugc_t* gc, ugc_thread_t* thread)
+{
+	struct mutator_s* mutator = thread->userdata;
+	if(mutator->root) { ugc_visit(gc, &mutator->root->header); }
+}
+
+static void*
+run_mutator(void* mutator_)
+{
+	struct mutator_s* mutator = mutator_;
+	ugc_t* gc = mutator->gc;
+
+	ugc_thread_attach(gc, &mutator->thread, scan_mutator);
+
+	for(int i = 0; i < MUTATOR_NUM_OBJS; ++i)
+	{
+		gc_obj_t* obj = &mutator->objs[i];
+		if(mutator->local)
+		{
+			obj->live = true;
+			obj->ref = NULL;
+			ugc_register_local(gc, &mutator->thread, &obj->header);
+		}
+		else
+		{
+			alloc(gc, obj);
+		}
+
+		if(i % 16 == 0)
+		{
+			// Drop the current list
+			mutator->root = obj;
+		}
+		else if(i % 3 == 0)
+		{
+			// Insert after the head which may already be black
+			set_ref(gc, obj, mutator->root->ref);
+			set_ref(gc, mutator->root, obj);
+		}
+		else
+		{
+			set_ref(gc, obj, mutator->root);
+			mutator->root = obj;
+		}
+
+		ugc_safepoint(gc, &mutator->thread);
+	}
+
+	ugc_thread_block(gc, &mutator->thread);
+	atomic_store(&mutator->done, true);
+	while(!atomic_load(mutator->finish)) { sched_yield(); }
+	ugc_thread_unblock(gc, &mutator->thread);
+
+	ugc_thread_detach(gc, &mutator->thread);
+	return NULL;
+}
+
+static MunitResult
+threads(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+	fixture_t* fixture = fixture_;
+	ugc_t* gc = fixture->gc;
+
+	static struct mutator_s mutators[MUTATOR_NUM_THREADS];
+	pthread_t handles[MUTATOR_NUM_THREADS];
+	atomic_bool finish = false;
+
+	for(int i = 0; i < MUTATOR_NUM_THREADS; ++i)
+	{
+		mutators[i] = (struct mutator_s){
+			.gc = gc,
+			.thread = { .userdata = &mutators[i] },
+			.local = i % 2 == 1,
+			.finish = &finish
+		};
+		pthread_create(&handles[i], NULL, run_mutator, &mutators[i]);
+	}
+
+	for(bool done = false; !done;)
+	{
+		ugc_safepoint_begin(gc, NULL);
+		for(int i = 0; i < 10; ++i) { ugc_step(gc); }
+		ugc_safepoint_end(gc);
+
+		done = true;
+		for(int i = 0; i < MUTATOR_NUM_THREADS; ++i)
+		{
+			done = done && atomic_load(&mutators[i].done);
+		}
+	}
+
+	ugc_safepoint_begin(gc, NULL);
+	ugc_collect(gc);
+	ugc_collect(gc);
+	ugc_safepoint_end(gc);
+
+	for(int i = 0; i < MUTATOR_NUM_THREADS; ++i)
+	{
+		struct mutator_s* mutator = &mutators[i];
+		int num_live = 0;
+		for(gc_obj_t* itr = mutator->root; itr != NULL; itr = itr->ref)
+		{
+			munit_assert_true(itr->live);
+			++num_live;
+		}
+
+		for(int j = 0; j < MUTATOR_NUM_OBJS; ++j)
+		{
+			num_live -= mutator->objs[j].live;
+		}
+
+		munit_assert_int(num_live, ==, 0);
+	}
+
+	atomic_store(&finish, true);
+	for(int i = 0; i < MUTATOR_NUM_THREADS; ++i)
+	{
+		pthread_join(handles[i], NULL);
+	}
+
+	munit_assert_null(gc->threads);
+	ugc_release_all(gc);
+
+	return MUNIT_OK;
+}
+
+#define GROUP_NUM_HEAPS 8
+#define GROUP_NUM_WORKERS 3
+
+static void*
+run_group_step(void* group)
+{
+	ugc_group_step(group, NULL);
+	return NULL;
+}
+
+static void*
+run_group_collect(void* group)
+{
+	ugc_group_collect(group, NULL);
+	return NULL;
+}
+
+static void
+run_group(ugc_group_t* group, void*(*fn)(void*))
+{
+	pthread_t workers[GROUP_NUM_WORKERS];
+
+	ugc_group_reset(group, GROUP_NUM_HEAPS);
+	for(int i = 0; i < GROUP_NUM_WORKERS; ++i)
+	{
+		pthread_create(&workers[i], NULL, fn, group);
+	}
+
+	for(int i = 0; i < GROUP_NUM_WORKERS; ++i)
+	{
+		pthread_join(workers[i], NULL);
+	}
+}
+
+static void
+scan_group_thread(ugc_t* gc, ugc_thread_t* thread)
+{
+	gc_obj_t* root = thread->userdata;
+	ugc_visit(gc, &root->header);
+}
+
+static MunitResult
+group(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+	(void)fixture_;
+
+	ugc_t gcs[GROUP_NUM_HEAPS];
+	ugc_t* heaps[GROUP_NUM_HEAPS];
+	fixture_t fixtures[GROUP_NUM_HEAPS];
+	gc_obj_t a[GROUP_NUM_HEAPS], b[GROUP_NUM_HEAPS], c[GROUP_NUM_HEAPS];
+	ugc_handle_t handles[GROUP_NUM_HEAPS];
+
+	for(int i = 0; i < GROUP_NUM_HEAPS; ++i)
+	{
+		ugc_t* gc = &gcs[i];
+		ugc_init(gc, scan_gc_obj, free_gc_obj);
+		fixtures[i] = (fixture_t){ .gc = gc };
+		gc->userdata = &fixtures[i];
+		gc->budget = i + 1;
+		heaps[i] = gc;
+
+		alloc(gc, &a[i]);
+		alloc(gc, &b[i]);
+		alloc(gc, &c[i]);
+		set_ref(gc, &a[i], &b[i]);
+		// Only referred to by the handle
+		ugc_handle_set(gc, &handles[i], &a[i].header);
+	}
+
+	ugc_group_t group;
+	ugc_group_init(&group, heaps, GROUP_NUM_HEAPS);
+
+	for(int round = 0; round < 10; ++round)
+	{
+		run_group(&group, run_group_step);
+	}
+
+	run_group(&group, run_group_collect);
+	run_group(&group, run_group_collect);
+
+	for(int i = 0; i < GROUP_NUM_HEAPS; ++i)
+	{
+		munit_assert_true(a[i].live);
+		munit_assert_true(b[i].live);
+		munit_assert_true(!c[i].live);
+
+		ugc_handle_clear(&gcs[i], &handles[i]);
+	}
+
+	run_group(&group, run_group_collect);
+	run_group(&group, run_group_collect);
+
+	for(int i = 0; i < GROUP_NUM_HEAPS; ++i)
+	{
+		munit_assert_true(!a[i].live);
+		munit_assert_true(!b[i].live);
+	}
+
+	// A thread attached to a GC of the group can collect it too
+	gc_obj_t d;
+	ugc_thread_t self;
+	self.userdata = &d;
+	ugc_thread_attach(&gcs[0], &self, scan_group_thread);
+	alloc(&gcs[0], &d);
+
+	for(int i = 0; i < 2; ++i)
+	{
+		ugc_group_reset(&group, GROUP_NUM_HEAPS);
+		munit_assert_size(ugc_group_collect(&group, &self), ==, GROUP_NUM_HEAPS);
+	}
+
+	munit_assert_true(d.live);
+	ugc_thread_detach(&gcs[0], &self);
+
+	return MUNIT_OK;
+}
+
+#endif
+
+#if UGC_USE_EPOCHS
+
+#define READER_NUM_OBJS 2000
+
+static struct
+{
+	ugc_t* gc;
+	ugc_reader_t reader;
+	_Atomic(gc_obj_t*) shared;
+	atomic_bool done;
+	atomic_int num_errors;
+} epoch_reader;
+
+static void
+scan_epochs(ugc_t* gc, ugc_header_t* obj)
+{
+	if(obj != NULL) { return; }
+
+	gc_obj_t* shared = atomic_load(&epoch_reader.shared);
+	if(shared) { ugc_visit(gc, &shared->header); }
+}
+
+static void*
+run_reader(void* arg)
+{
+	(void)arg;
+	ugc_t* gc = epoch_reader.gc;
+
+	while(!atomic_load(&epoch_reader.done))
+	{
+		ugc_read_begin(gc, &epoch_reader.reader);
+		gc_obj_t* obj = atomic_load(&epoch_reader.shared);
+		if(obj != NULL && !obj->live) { atomic_fetch_add(&epoch_reader.num_errors, 1); }
+		ugc_read_end(&epoch_reader.reader);
+	}
+
+	return NULL;
+}
+
+static MunitResult
+epochs(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+	fixture_t* fixture = fixture_;
+	ugc_t* gc = fixture->gc;
+
+	gc_obj_t objs[3];
+	for(int i = 0; i < 3; ++i) { alloc(gc, &objs[i]); }
+	fixture->root = &objs[0];
+	set_ref(gc, &objs[0], &objs[1]);
+
+	ugc_reader_t reader;
+	ugc_reader_attach(gc, &reader);
+
+	// Garbage is released right away while no reader is in a read section
+	ugc_collect(gc);
+	munit_assert_false(objs[2].live);
+
+	ugc_read_begin(gc, &reader);
+	set_ref(gc, &objs[0], NULL);
+	ugc_collect(gc);
+	ugc_collect(gc);
+	munit_assert_true(objs[1].live);
+	ugc_read_end(&reader);
+	ugc_reclaim(gc);
+	munit_assert_false(objs[1].live);
+
+	// A read section started after garbage was found does not hold it
+	alloc(gc, &objs[1]);
+	ugc_collect(gc);
+	munit_assert_false(objs[1].live);
+	alloc(gc, &objs[1]);
+	ugc_read_begin(gc, &reader);
+	ugc_collect(gc);
+	munit_assert_true(objs[1].live);
+	ugc_read_end(&reader);
+	ugc_read_begin(gc, &reader);
+	ugc_reclaim(gc);
+	munit_assert_false(objs[1].live);
+	ugc_read_end(&reader);
+
+	ugc_reader_detach(gc, &reader);
+	fixture->root = NULL;
+	ugc_collect(gc);
+	munit_assert_false(objs[0].live);
+
+	// A reader never sees a released object
+	gc->scan_fn = scan_epochs;
+	epoch_reader.gc = gc;
+	atomic_init(&epoch_reader.shared, NULL);
+	atomic_init(&epoch_reader.done, false);
+	atomic_init(&epoch_reader.num_errors, 0);
+	ugc_reader_attach(gc, &epoch_reader.reader);
+
+	pthread_t handle;
+	pthread_create(&handle, NULL, run_reader, NULL);
+
+	gc_obj_t* shared_objs = malloc(sizeof(gc_obj_t) * READER_NUM_OBJS);
+	for(int i = 0; i < READER_NUM_OBJS; ++i)
+	{
+		alloc(gc, &shared_objs[i]);
+		atomic_store(&epoch_reader.shared, &shared_objs[i]);
+		ugc_step(gc);
+	}
+
+	atomic_store(&epoch_reader.done, true);
+	pthread_join(handle, NULL);
+	ugc_reader_detach(gc, &epoch_reader.reader);
+	munit_assert_int(atomic_load(&epoch_reader.num_errors), ==, 0);
+
+	atomic_store(&epoch_reader.shared, NULL);
+	ugc_collect_full(gc);
+	for(int i = 0; i < READER_NUM_OBJS; ++i) { munit_assert_false(shared_objs[i].live); }
+	free(shared_objs);
+
+	return MUNIT_OK;
+}
+
+#endif
+
+static MunitTest tests[] = {
+	{
+		.name = "/basic",
+		.test = basic,
+		.setup = setup,
+		.tear_down = teardown
+	},
+	{
+		.name = "/root",
+		.test = root,
+		.setup = setup,
+		.tear_down = teardown
+	},
+	{
+		.name = "/write_barrier",
+		.test = write_barrier,
+		.setup = setup,
+		.tear_down = teardown
+	},
+	{
+		.name = "/root_change",
+		.test = root_change,
+		.setup = setup,
+		.tear_down = teardown
+	},
+	{
+		.name = "/interupt_sweep",
+		.test = interupt_sweep,
+		.setup = setup,
+		.tear_down = teardown
+	},
+	{
+		.name = "/release_all",
+		.test = release_all,
+		.setup = setup,
+		.tear_down = teardown
+	},
+	{
+		.name = "/release_all_sweep",
+		.test = release_all_sweep,
+		.setup = setup,
+		.tear_down = teardown
+	},
+	{
+		.name = "/collect_full",
+		.test = collect_full,
+		.setup = setup,
+		.tear_down = teardown
+	},
+#if UGC_USE_STATS
+	{
+		.name = "/stats",
+		.test = stats,
+		.setup = setup,
+		.tear_down = teardown
+	},
+#endif
+#if UGC_USE_PERF
+	{
+		.name = "/perf",
+		.test = perf,
+		.setup = setup,
+		.tear_down = teardown
+	},
+#endif
+#if UGC_USE_RECORD
+	{
+		.name = "/record",
+		.test = record,
+		.setup = setup,
+		.tear_down = teardown
+	},
+#endif
+#if UGC_USE_PROFILE
+	{
+		.name = "/profile",
+		.test = profile,
+		.setup = NULL,
+		.tear_down = NULL
+	},
+#endif
+#if UGC_USE_PACER
+	{
+		.name = "/pacer",
+		.test = pacer,
+		.setup = setup,
+		.tear_down = teardown
+	},
+#endif
+#if UGC_USE_LAYOUT
+	{
+		.name = "/layout",
+		.test = layout,
+		.setup = NULL,
+		.tear_down = NULL
+	},
+#endif
+#if UGC_USE_CONSERVATIVE
+	{
+		.name = "/address_index",
+		.test = address_index,
+		.setup = setup,
+		.tear_down = teardown
+	},
+	{
+		.name = "/conservative",
+		.test = conservative,
+		.setup = setup,
+		.tear_down = teardown
+	},
+#if UGC_USE_THREADS
+	{
+		.name = "/conservative_threads",
+		.test = conservative_threads,
+		.setup = setup,
+		.tear_down = teardown
+	},
+#if UGC_BLOCK_STUB && defined(__x86_64__)
+	{
+		.name = "/conservative_blocked",
+		.test = conservative_blocked,
+		.setup = setup,
+		.tear_down = teardown
+	},
+#endif
+#endif
+#endif
+#if UGC_USE_FIBERS
+	{
+		.name = "/fibers",
+		.test = fibers,
+		.setup = setup,
+		.tear_down = teardown
+	},
+#endif
+#if UGC_USE_PINS
+	{
+		.name = "/pins",
+		.test = pins,
+		.setup = setup,
+		.tear_down = teardown
+	},
+#endif
+#if UGC_USE_WEAK
+	{
+		.name = "/weak",
+		.test = weak,
+		.setup = setup,
+		.tear_down = teardown
+	},
+#endif
+#if UGC_USE_LARGE
+	{
+		.name = "/large",
+		.test = large,
+		.setup = setup,
+		.tear_down = teardown
+	},
+#endif
+#if UGC_USE_REGIONS
+	{
+		.name = "/regions",
+		.test = regions,
+		.setup = setup,
+		.tear_down = teardown
+	},
+#endif
+#if UGC_USE_FINALIZERS
+	{
+		.name = "/finalizers",
+		.test = finalizers,
+		.setup = setup,
+		.tear_down = teardown
+	},
+#endif
+#if UGC_USE_EVACUATION
+	{
+		.name = "/evacuation",
+		.test = evacuation,
+		.setup = setup,
+		.tear_down = teardown
+	},
+#endif
+#if UGC_USE_SORT
+	{
+		.name = "/sort",
+		.test = sort,
+		.setup = setup,
+		.tear_down = teardown
+	},
+#endif
+#if UGC_USE_TRACE
+	{
+		.name = "/trace",
+		.test = trace,
+		.setup = setup,
+		.tear_down = teardown
+	},
+#endif
+	{
+		.name = "/register_chain",
+		.test = register_chain,
+		.setup = setup,
+		.tear_down = teardown
+	},
+	{
+		.name = "/merge",
+		.test = merge,
+		.setup = setup,
+		.tear_down = teardown
+	},
+#if UGC_USE_THREADS
+	{
+		.name = "/threads",
+		.test = threads,
+		.setup = setup,
+		.tear_down = teardown
+	},
+	{
+		.name = "/group",
+		.test = group,
+		.setup = setup,
+		.tear_down = teardown
+	},
+#endif
+#if UGC_USE_EPOCHS
+	{
+		.name = "/epochs",
+		.test = epochs,
+		.setup = setup,
+		.tear_down = teardown
+	},
+#endif
 	{ .test = NULL }
 };
 
@@ -0,0 +1,493 @@
+#include <stddef.h>
+#include <munit/munit.h>
+
+#include "ugc.hpp"
+
+namespace
+{
+
+struct gc_obj_t
+{
+	ugc_header_t header;
+	gc_obj_t* ref;
+	bool live;
+};
+
+struct traits_t;
+typedef ugc::heap<traits_t> heap_t;
+
+struct traits_t
+{
+	gc_obj_t* root;
+	int num_scans;
+
+	void
+	scan_roots(heap_t& heap)
+	{
+		if(root) { heap.visit(&root->header); }
+	}
+
+	void
+	scan(heap_t& heap, ugc_header_t* obj)
+	{
+		++num_scans;
+		gc_obj_t* ref = reinterpret_cast<gc_obj_t*>(obj)->ref;
+		if(ref) { heap.visit(&ref->header); }
+	}
+
+	void
+	release(heap_t&, ugc_header_t* obj_)
+	{
+		gc_obj_t* obj = reinterpret_cast<gc_obj_t*>(obj_);
+		munit_assert_true(obj->live);
+		obj->live = false;
+	}
+};
+
+const traits_t no_root = { NULL, 0 };
+
+void
+alloc(heap_t& heap, gc_obj_t* obj)
+{
+	obj->live = true;
+	obj->ref = NULL;
+	heap.add(&obj->header);
+}
+
+template<ugc_barrier_direction_e Direction>
+void
+set_ref(heap_t& heap, gc_obj_t* src, gc_obj_t* dst)
+{
+	src->ref = dst;
+	if(dst) { heap.write_barrier<Direction>(&src->header, &dst->header); }
+}
+
+MunitResult
+basic(const MunitParameter[], void*)
+{
+	heap_t heap(no_root);
+
+	gc_obj_t a, b, c;
+
+	alloc(heap, &a);
+	alloc(heap, &b);
+	alloc(heap, &c);
+	set_ref<UGC_BARRIER_BACKWARD>(heap, &a, &b);
+	set_ref<UGC_BARRIER_BACKWARD>(heap, &b, &c);
+	heap.traits().root = &a;
+
+	heap.collect();
+
+	munit_assert_true(a.live);
+	munit_assert_true(b.live);
+	munit_assert_true(c.live);
+
+	heap.traits().root = NULL;
+	heap.collect();
+
+	munit_assert_true(!a.live);
+	munit_assert_true(!b.live);
+	munit_assert_true(!c.live);
+	munit_assert_int(heap.state(), ==, UGC_IDLE);
+
+	return MUNIT_OK;
+}
+
+template<ugc_barrier_direction_e Direction>
+MunitResult
+write_barrier(const MunitParameter[], void*)
+{
+	heap_t heap(no_root);
+
+	gc_obj_t a, b, c, d;
+
+	alloc(heap, &a);
+	alloc(heap, &b);
+	alloc(heap, &c);
+	set_ref<Direction>(heap, &a, &b);
+	set_ref<Direction>(heap, &b, &c);
+	heap.traits().root = &a;
+
+	while(heap_t::color(&c.header) != !heap.white()) { heap.step(); }
+
+	alloc(heap, &d);
+	set_ref<Direction>(heap, &b, &d);
+
+	heap.collect();
+
+	munit_assert_true(a.live);
+	munit_assert_true(b.live);
+	munit_assert_true(c.live);
+	munit_assert_true(d.live);
+
+	heap.collect();
+
+	munit_assert_true(a.live);
+	munit_assert_true(b.live);
+	munit_assert_true(!c.live);
+	munit_assert_true(d.live);
+
+	// The runtime direction goes through the same code
+	gc_obj_t e;
+	while(heap.state() != UGC_MARK) { heap.step(); }
+	while(heap_t::color(&d.header) != !heap.white()) { heap.step(); }
+	alloc(heap, &e);
+	d.ref = &e;
+	heap.write_barrier(Direction, &d.header, &e.header);
+
+	heap.collect();
+	heap.collect();
+
+	munit_assert_true(d.live);
+	munit_assert_true(e.live);
+
+	return MUNIT_OK;
+}
+
+MunitResult
+interupt_sweep(const MunitParameter[], void*)
+{
+	heap_t heap(no_root);
+
+	gc_obj_t a, b, c;
+
+	alloc(heap, &a);
+	alloc(heap, &b);
+	heap.traits().root = &a;
+
+	while(heap.state() != UGC_SWEEP) { heap.step(); }
+
+	alloc(heap, &c);
+	set_ref<UGC_BARRIER_FORWARD>(heap, &a, &c);
+
+	heap.collect();
+
+	munit_assert_true(a.live);
+	munit_assert_true(!b.live);
+	munit_assert_true(c.live);
+
+	heap.collect();
+
+	munit_assert_true(a.live);
+	munit_assert_true(!b.live);
+	munit_assert_true(c.live);
+
+	return MUNIT_OK;
+}
+
+MunitResult
+collect_full(const MunitParameter[], void*)
+{
+	heap_t heap(no_root);
+
+	for(int state = UGC_IDLE; state <= UGC_SWEEP; ++state)
+	{
+		gc_obj_t a, b, c, d;
+
+		alloc(heap, &a);
+		alloc(heap, &b);
+		alloc(heap, &c);
+		set_ref<UGC_BARRIER_BACKWARD>(heap, &a, &b);
+		set_ref<UGC_BARRIER_BACKWARD>(heap, &b, &c);
+		heap.traits().root = &a;
+
+		while(heap_t::color(&c.header) != !heap.white()) { heap.step(); }
+		while(heap.state() != state) { heap.step(); }
+
+		alloc(heap, &d);
+		set_ref<UGC_BARRIER_BACKWARD>(heap, &c, &d);
+		set_ref<UGC_BARRIER_BACKWARD>(heap, &a, NULL);
+
+		heap.traits().num_scans = 0;
+		heap.collect_full();
+
+		munit_assert_int(heap.state(), ==, UGC_IDLE);
+		munit_assert_int(heap.traits().num_scans, ==, 1);
+		munit_assert_true(a.live);
+		munit_assert_true(!b.live);
+		munit_assert_true(!c.live);
+		munit_assert_true(!d.live);
+
+		heap.traits().root = NULL;
+		heap.collect_full();
+		munit_assert_true(!a.live);
+	}
+
+	return MUNIT_OK;
+}
+
+MunitResult
+release_all(const MunitParameter[], void*)
+{
+	gc_obj_t a, b, c, d;
+
+	for(int state = UGC_IDLE; state <= UGC_SWEEP; ++state)
+	{
+		heap_t heap(no_root);
+
+		alloc(heap, &a);
+		alloc(heap, &b);
+		alloc(heap, &c);
+		a.ref = &b;
+		heap.traits().root = &a;
+
+		while(heap.state() != state) { heap.step(); }
+		if(state == UGC_SWEEP) { heap.step(); }
+
+		// release asserts that objects are not released twice
+		heap.release_all();
+
+		munit_assert_true(!a.live);
+		munit_assert_true(!b.live);
+		munit_assert_true(!c.live);
+
+		// The heap is reusable and releases its objects on destruction
+		alloc(heap, &d);
+	}
+
+	munit_assert_true(!d.live);
+
+	return MUNIT_OK;
+}
+
+struct node_t
+{
+	ugc_header_t header;
+	ugc::field<node_t> ref;
+	node_t* slots[2];
+	ugc::array<node_t> items;
+	bool live;
+};
+
+node_t* node_root = NULL;
+
+template<typename Heap>
+void
+scan_node(Heap& heap, ugc_header_t* obj)
+{
+	node_t* node = reinterpret_cast<node_t*>(obj);
+	node->ref.visit(heap);
+	node->items.visit(heap);
+}
+
+void
+release_node(ugc_header_t* obj)
+{
+	node_t* node = reinterpret_cast<node_t*>(obj);
+	munit_assert_true(node->live);
+	node->live = false;
+}
+
+struct node_traits_t;
+typedef ugc::heap<node_traits_t> node_heap_t;
+
+struct node_traits_t
+{
+	void
+	scan_roots(node_heap_t& heap)
+	{
+		if(node_root) { heap.visit(&node_root->header); }
+	}
+
+	void
+	scan(node_heap_t& heap, ugc_header_t* obj)
+	{
+		scan_node(heap, obj);
+	}
+
+	void
+	release(node_heap_t&, ugc_header_t* obj)
+	{
+		release_node(obj);
+	}
+};
+
+void
+scan_node_c(ugc_t* gc, ugc_header_t* obj)
+{
+	if(obj != NULL)
+	{
+		scan_node(*gc, obj);
+	}
+	else if(node_root)
+	{
+		ugc_visit(gc, &node_root->header);
+	}
+}
+
+void
+release_node_c(ugc_t*, ugc_header_t* obj)
+{
+	release_node(obj);
+}
+
+void
+alloc(node_heap_t& heap, node_t* node)
+{
+	node->live = true;
+	node->slots[0] = node->slots[1] = NULL;
+	heap.add(&node->header);
+}
+
+void
+alloc(ugc_t& gc, node_t* node)
+{
+	node->live = true;
+	node->slots[0] = node->slots[1] = NULL;
+	ugc_register(&gc, &node->header);
+}
+
+bool
+is_black(node_heap_t& heap, node_t* node)
+{
+	return node_heap_t::color(&node->header) == !heap.white();
+}
+
+bool
+is_black(ugc_t& gc, node_t* node)
+{
+	return ugc::detail::color(&node->header) == !gc.white;
+}
+
+void
+step(node_heap_t& heap)
+{
+	heap.step();
+}
+
+void
+step(ugc_t& gc)
+{
+	ugc_step(&gc);
+}
+
+void
+collect(node_heap_t& heap)
+{
+	heap.collect();
+}
+
+void
+collect(ugc_t& gc)
+{
+	ugc_collect(&gc);
+}
+
+template<typename Heap>
+void
+references(Heap& heap)
+{
+	node_t a, b, c, d, e;
+	a.items.reset(a.slots, 2);
+	b.items.reset(b.slots, 2);
+	c.items.reset(c.slots, 0);
+	d.items.reset(d.slots, 0);
+	e.items.reset(e.slots, 0);
+
+	alloc(heap, &a);
+	alloc(heap, &b);
+	alloc(heap, &c);
+	alloc(heap, &d);
+	node_root = &a;
+	a.ref.set(heap, &a, &b);
+
+	while(!is_black(heap, &b)) { step(heap); }
+
+	// Forward: the child is shaded, the parent stays black
+	b.ref.set(heap, &b, &c);
+	munit_assert_false(is_black(heap, &c));
+	munit_assert_true(is_black(heap, &b));
+
+	// Backward: the parent is grayed again
+	a.items.set(heap, &a, 0, &d);
+	munit_assert_false(is_black(heap, &a));
+
+	// Storing NULL does not need a barrier
+	b.ref.set(heap, &b, static_cast<node_t*>(NULL));
+	b.ref.set(heap, &b, &c);
+
+	alloc(heap, &e);
+	a.items.set(heap, &a, 1, &e);
+
+	munit_assert_ptr_equal(a.items[0], &d);
+	munit_assert_ptr_equal(a.items[1], &e);
+	munit_assert_ptr_equal(b.ref.get(), &c);
+
+	collect(heap);
+	collect(heap);
+
+	munit_assert_true(a.live);
+	munit_assert_true(b.live);
+	munit_assert_true(c.live);
+	munit_assert_true(d.live);
+	munit_assert_true(e.live);
+
+	node_root = NULL;
+	collect(heap);
+	collect(heap);
+
+	munit_assert_true(!a.live);
+	munit_assert_true(!e.live);
+}
+
+MunitResult
+references_heap(const MunitParameter[], void*)
+{
+	node_heap_t heap;
+	references(heap);
+
+	return MUNIT_OK;
+}
+
+MunitResult
+references_c(const MunitParameter[], void*)
+{
+	ugc_t gc;
+	ugc_init(&gc, scan_node_c, release_node_c);
+	references(gc);
+	ugc_release_all(&gc);
+
+	return MUNIT_OK;
+}
+
+MunitTest tests[] = {
+	{ const_cast<char*>("/basic"), basic, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{
+		const_cast<char*>("/write_barrier_forward"),
+		write_barrier<UGC_BARRIER_FORWARD>,
+		NULL,
+		NULL,
+		MUNIT_TEST_OPTION_NONE,
+		NULL
+	},
+	{
+		const_cast<char*>("/write_barrier_backward"),
+		write_barrier<UGC_BARRIER_BACKWARD>,
+		NULL,
+		NULL,
+		MUNIT_TEST_OPTION_NONE,
+		NULL
+	},
+	{ const_cast<char*>("/interupt_sweep"), interupt_sweep, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ const_cast<char*>("/collect_full"), collect_full, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ const_cast<char*>("/release_all"), release_all, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ const_cast<char*>("/references"), references_heap, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ const_cast<char*>("/references_c"), references_c, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+const MunitSuite suite = {
+	const_cast<char*>("/heap"),
+	tests,
+	NULL,
+	1,
+	MUNIT_SUITE_OPTION_NONE
+};
+
+}
+
+int
+main(int argc, char* argv[])
+{
+	return munit_suite_main(&suite, NULL, argc, argv);
+}
@@ -0,0 +1,373 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+
+#ifndef UGC_IMPLEMENTATION
+#define UGC_IMPLEMENTATION
+#endif
+
+#define UGC_USE_RECORD 1
+#define UGC_USE_STATS 1
+
+#include "ugc.h"
+
+typedef struct replay_obj_s replay_obj_t;
+typedef struct replay_s replay_t;
+
+// Synthetic object, its edges are the ones reported during its last recorded
+// scan
+struct replay_obj_s
+{
+	ugc_header_t header;
+	uintptr_t id;
+	size_t num_edges;
+	size_t capacity;
+	uintptr_t* edges;
+};
+
+struct replay_s
+{
+	ugc_t gc;
+
+	// Recorded ids to live objects, open addressing with linear probing
+	replay_obj_t** objs;
+	size_t capacity;
+	size_t num_objs;
+
+	replay_obj_t root;
+	replay_obj_t* scanning;
+
+	uint64_t num_ops[UGC_RECORD_RESCAN_ROOTS + 1];
+	uint64_t num_missing;
+	uint64_t gc_time;
+	uint64_t barrier_time;
+};
+
+static uint64_t
+now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static size_t
+slot_of(replay_t* replay, uintptr_t id)
+{
+	uint64_t hash = (uint64_t)id * 0x9e3779b97f4a7c15ull;
+	return (size_t)(hash >> 32) & (replay->capacity - 1);
+}
+
+static replay_obj_t*
+lookup(replay_t* replay, uintptr_t id)
+{
+	for(size_t i = slot_of(replay, id); ; i = (i + 1) & (replay->capacity - 1))
+	{
+		replay_obj_t* obj = replay->objs[i];
+		if(obj == NULL || obj->id == id) { return obj; }
+	}
+}
+
+static void insert(replay_t* replay, replay_obj_t* obj);
+
+static void
+grow(replay_t* replay)
+{
+	replay_obj_t** objs = replay->objs;
+	size_t capacity = replay->capacity;
+
+	replay->capacity = capacity * 2;
+	replay->objs = calloc(replay->capacity, sizeof(replay_obj_t*));
+	replay->num_objs = 0;
+
+	for(size_t i = 0; i < capacity; ++i)
+	{
+		if(objs[i] != NULL) { insert(replay, objs[i]); }
+	}
+
+	free(objs);
+}
+
+static void
+insert(replay_t* replay, replay_obj_t* obj)
+{
+	if((replay->num_objs + 1) * 2 > replay->capacity) { grow(replay); }
+
+	size_t i = slot_of(replay, obj->id);
+	while(replay->objs[i] != NULL && replay->objs[i]->id != obj->id)
+	{
+		i = (i + 1) & (replay->capacity - 1);
+	}
+
+	// An address can be reused by the recorded program once our collector
+	// released its previous occupant. Forget about the previous one.
+	if(replay->objs[i] == NULL) { ++replay->num_objs; }
+	replay->objs[i] = obj;
+}
+
+static void
+remove_obj(replay_t* replay, replay_obj_t* obj)
+{
+	size_t mask = replay->capacity - 1;
+	size_t i = slot_of(replay, obj->id);
+	while(replay->objs[i] != NULL && replay->objs[i]->id != obj->id) { i = (i + 1) & mask; }
+	if(replay->objs[i] != obj) { return; }
+
+	// Backward shift deletion
+	size_t hole = i;
+	for(size_t j = (i + 1) & mask; replay->objs[j] != NULL; j = (j + 1) & mask)
+	{
+		size_t home = slot_of(replay, replay->objs[j]->id);
+		if(((j - home) & mask) >= ((j - hole) & mask))
+		{
+			replay->objs[hole] = replay->objs[j];
+			hole = j;
+		}
+	}
+
+	replay->objs[hole] = NULL;
+	--replay->num_objs;
+}
+
+static void
+scan_obj(ugc_t* gc, ugc_header_t* header)
+{
+	replay_t* replay = gc->userdata;
+	replay_obj_t* obj = header != NULL ? (replay_obj_t*)header : &replay->root;
+
+	for(size_t i = 0; i < obj->num_edges; ++i)
+	{
+		replay_obj_t* child = lookup(replay, obj->edges[i]);
+		if(child != NULL)
+		{
+			ugc_visit(gc, &child->header);
+		}
+		else
+		{
+			++replay->num_missing;
+		}
+	}
+}
+
+static void
+release_obj(ugc_t* gc, ugc_header_t* header)
+{
+	replay_t* replay = gc->userdata;
+	replay_obj_t* obj = (replay_obj_t*)header;
+
+	remove_obj(replay, obj);
+	if(replay->scanning == obj) { replay->scanning = NULL; }
+	free(obj->edges);
+	free(obj);
+}
+
+static void
+add_edge(replay_obj_t* obj, uintptr_t id)
+{
+	if(obj->num_edges == obj->capacity)
+	{
+		obj->capacity = obj->capacity > 0 ? obj->capacity * 2 : 4;
+		obj->edges = realloc(obj->edges, obj->capacity * sizeof(uintptr_t));
+	}
+
+	obj->edges[obj->num_edges++] = id;
+}
+
+static int
+run(replay_t* replay, ugc_record_reader_t* reader)
+{
+	ugc_t* gc = &replay->gc;
+	ugc_record_op_t op;
+	int result;
+
+	while((result = ugc_record_read(reader, &op)) == 1)
+	{
+		++replay->num_ops[op.type];
+
+		switch(op.type)
+		{
+			case UGC_RECORD_REGISTER:
+				{
+					replay_obj_t* obj = calloc(1, sizeof(replay_obj_t));
+					obj->id = op.obj;
+					insert(replay, obj);
+
+					uint64_t start = now();
+					ugc_register(gc, &obj->header);
+					replay->gc_time += now() - start;
+				}
+				break;
+			case UGC_RECORD_BARRIER_FORWARD:
+			case UGC_RECORD_BARRIER_BACKWARD:
+				{
+					replay_obj_t* parent = lookup(replay, op.obj);
+					replay_obj_t* child = lookup(replay, op.child);
+					if(parent == NULL || child == NULL)
+					{
+						++replay->num_missing;
+						break;
+					}
+
+					uint64_t start = now();
+					ugc_write_barrier(
+						gc,
+						op.type == UGC_RECORD_BARRIER_FORWARD
+							? UGC_BARRIER_FORWARD
+							: UGC_BARRIER_BACKWARD,
+						&parent->header,
+						&child->header
+					);
+					uint64_t duration = now() - start;
+					replay->gc_time += duration;
+					replay->barrier_time += duration;
+				}
+				break;
+			case UGC_RECORD_STEP:
+				{
+					uint64_t start = now();
+					ugc_step(gc);
+					replay->gc_time += now() - start;
+				}
+				break;
+			case UGC_RECORD_COLLECT_FULL:
+				{
+					uint64_t start = now();
+					ugc_collect_full(gc);
+					replay->gc_time += now() - start;
+				}
+				break;
+			case UGC_RECORD_RELEASE_ALL:
+				// The GC can't be used afterwards, main takes care of it
+				return 0;
+			case UGC_RECORD_SCAN_ROOTS:
+				replay->scanning = &replay->root;
+				replay->root.num_edges = 0;
+				break;
+			case UGC_RECORD_RESCAN_ROOTS:
+				replay->scanning = &replay->root;
+				break;
+			case UGC_RECORD_SCAN:
+				replay->scanning = lookup(replay, op.obj);
+				if(replay->scanning != NULL)
+				{
+					replay->scanning->num_edges = 0;
+				}
+				else
+				{
+					++replay->num_missing;
+				}
+				break;
+			case UGC_RECORD_EDGE:
+				if(replay->scanning != NULL) { add_edge(replay->scanning, op.obj); }
+				break;
+		}
+	}
+
+	return result;
+}
+
+static void
+print_phase(const char* name, const ugc_histogram_t* histogram)
+{
+	printf(
+		"%-12s %12" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 "\n",
+		name,
+		histogram->count,
+		ugc_histogram_percentile(histogram, 0.5),
+		ugc_histogram_percentile(histogram, 0.99),
+		histogram->max
+	);
+}
+
+int
+main(int argc, char* argv[])
+{
+	if(argc != 2)
+	{
+		fprintf(stderr, "Usage: %s <recording>\n", argv[0]);
+		return 1;
+	}
+
+	FILE* file = fopen(argv[1], "rb");
+	if(file == NULL)
+	{
+		perror(argv[1]);
+		return 1;
+	}
+
+	size_t size = 0;
+	size_t capacity = 1 << 20;
+	unsigned char* data = malloc(capacity);
+	size_t num_read;
+	while((num_read = fread(data + size, 1, capacity - size, file)) > 0)
+	{
+		size += num_read;
+		if(size == capacity)
+		{
+			capacity *= 2;
+			data = realloc(data, capacity);
+		}
+	}
+	fclose(file);
+
+	ugc_record_reader_t reader;
+	if(ugc_record_reader_init(&reader, data, size) != 0)
+	{
+		fprintf(stderr, "%s: not a recording\n", argv[1]);
+		free(data);
+		return 1;
+	}
+
+	replay_t* replay = calloc(1, sizeof(replay_t));
+	replay->capacity = 1024;
+	replay->objs = calloc(replay->capacity, sizeof(replay_obj_t*));
+	ugc_init(&replay->gc, scan_obj, release_obj);
+	replay->gc.userdata = replay;
+
+	uint64_t start = now();
+	int result = run(replay, &reader);
+	uint64_t total = now() - start;
+
+	if(result != 0)
+	{
+		fprintf(stderr, "%s: truncated or corrupted recording\n", argv[1]);
+	}
+
+	printf("total time (s)     %10.3f\n", (double)total / 1e9);
+	printf("collector time (s) %10.3f\n", (double)replay->gc_time / 1e9);
+	printf("registrations      %10" PRIu64 "\n", replay->num_ops[UGC_RECORD_REGISTER]);
+	printf("edges              %10" PRIu64 "\n", replay->num_ops[UGC_RECORD_EDGE]);
+	printf("cycles             %10" PRIu64 "\n", replay->gc.stats.num_cycles);
+
+	uint64_t num_barriers =
+		replay->num_ops[UGC_RECORD_BARRIER_FORWARD] +
+		replay->num_ops[UGC_RECORD_BARRIER_BACKWARD];
+	if(num_barriers > 0)
+	{
+		printf("barrier (ns)       %10.2f\n", (double)replay->barrier_time / (double)num_barriers);
+	}
+
+	// The collector under test may not release objects at the same time as
+	// the recorded one
+	if(replay->num_missing > 0)
+	{
+		printf("missing objects    %10" PRIu64 "\n", replay->num_missing);
+	}
+
+	printf("\n%-12s %12s %10s %10s %10s\n", "phase", "steps", "p50 (ns)", "p99 (ns)", "max (ns)");
+	print_phase("root", &replay->gc.stats.steps[UGC_PHASE_ROOT]);
+	print_phase("mark", &replay->gc.stats.steps[UGC_PHASE_MARK]);
+	print_phase("termination", &replay->gc.stats.steps[UGC_PHASE_TERMINATION]);
+	print_phase("sweep", &replay->gc.stats.steps[UGC_PHASE_SWEEP]);
+
+	ugc_release_all(&replay->gc);
+	free(replay->root.edges);
+	free(replay->objs);
+	free(replay);
+	free(data);
+
+	return result == 0 ? 0 : 1;
+}
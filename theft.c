@@ -18,6 +18,7 @@ enum gc_op_type_e
 	GC_CLEAR_REF,
 	GC_STEP,
 	GC_COLLECT,
+	GC_COLLECT_FULL,
 
 	GC_COUNT
 };
@@ -174,6 +175,28 @@ mark_slots(size_t len, gc_obj_t** slots)
 	}
 }
 
+static bool
+check_frees(bool verbose, size_t num_objs, gc_obj_t* objs)
+{
+	for(size_t i = 0; i < num_objs; ++i)
+	{
+		gc_obj_t* obj = &objs[i];
+
+		unsigned int expected_num_frees = obj->visited ? 0 : 1;
+		if(expected_num_frees != obj->num_frees)
+		{
+			if(verbose)
+			{
+				printf("-----------\n");
+				printf("obj#%zu.num_frees is %d instead of %d\n", i, obj->num_frees, expected_num_frees);
+			}
+			return false;
+		}
+	}
+
+	return true;
+}
+
 static gc_ref_info_t
 pick_ref(struct theft_mt* mt, size_t num_roots, gc_obj_t** root_slots)
 {
@@ -233,6 +256,7 @@ simulate_gc(
 	ugc_init(&gc, scan_obj, release_obj);
 	gc.userdata = &roots;
 	size_t num_objs = 0;
+	bool correct = true;
 
 	LOG("-----------------------\n");
 	LOG("Seed: %04zu\n", seed);
@@ -345,26 +369,36 @@ start:
 				ugc_collect(&gc);
 				LOG("gc_collect()\n");
 				break;
+			case GC_COLLECT_FULL:
+				{
+					if(theft_mt_random(mt) % 2 != 0) { goto start; }
+
+					if(num_drops > 0) { --num_drops; continue; }
+
+					ugc_collect_full(&gc);
+					LOG("gc_collect_full()\n");
+
+					// All unreachable objects must have been released
+					for(size_t j = 0; j < num_objs; ++j) { objs[j].visited = false; }
+					mark_slots(num_roots, root_slots);
+					if(!check_frees(verbose, num_objs, objs))
+					{
+						correct = false;
+						i = num_ops;
+					}
+				}
+				break;
 		}
 	}
 
-	ugc_collect(&gc);
-	ugc_collect(&gc);
-
-	mark_slots(num_roots, root_slots);
-	bool correct = true;
-	for(size_t i = 0; i < num_objs; ++i)
+	if(correct)
 	{
-		gc_obj_t* obj = &objs[i];
+		ugc_collect(&gc);
+		ugc_collect(&gc);
 
-		unsigned int expected_num_frees = obj->visited ? 0 : 1;
-		if(expected_num_frees != obj->num_frees)
-		{
-			LOG("-----------\n");
-			LOG("obj#%zu.num_frees is %d instead of %d\n", i, obj->num_frees, expected_num_frees);
-			correct = false;
-			break;
-		}
+		for(size_t i = 0; i < num_objs; ++i) { objs[i].visited = false; }
+		mark_slots(num_roots, root_slots);
+		correct = check_frees(verbose, num_objs, objs);
 	}
 
 	for(size_t i = 0; i < num_objs; ++i)
@@ -1,6 +1,15 @@
 #ifndef UGC_H
 #define UGC_H
 
+// clock_gettime and sched_yield are POSIX, this only takes effect when ugc.h
+// is included before any system header
+#if defined(UGC_IMPLEMENTATION) && !defined(_POSIX_C_SOURCE) && !defined(_GNU_SOURCE)
+#define _POSIX_C_SOURCE 199309L
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
+#endif
+
 #include <stddef.h>
 #include <stdint.h>
 
@@ -12,6 +21,146 @@
 #define UGC_USE_TAGGED_POINTER 1
 #endif
 
+#ifndef UGC_USE_THREADS
+#define UGC_USE_THREADS 0
+#endif
+
+#ifndef UGC_USE_STATS
+#define UGC_USE_STATS 0
+#endif
+
+#ifndef UGC_USE_TRACE
+#define UGC_USE_TRACE 0
+#endif
+
+#ifndef UGC_USE_PERF
+#define UGC_USE_PERF 0
+#endif
+
+#ifndef UGC_USE_RECORD
+#define UGC_USE_RECORD 0
+#endif
+
+#ifndef UGC_USE_PROFILE
+#define UGC_USE_PROFILE 0
+#endif
+
+#ifndef UGC_USE_PACER
+#define UGC_USE_PACER 0
+#endif
+
+#ifndef UGC_USE_LAYOUT
+#define UGC_USE_LAYOUT 0
+#endif
+
+#ifndef UGC_USE_CONSERVATIVE
+#define UGC_USE_CONSERVATIVE 0
+#endif
+
+#ifndef UGC_USE_FIBERS
+#define UGC_USE_FIBERS 0
+#endif
+
+#ifndef UGC_USE_PINS
+#define UGC_USE_PINS 0
+#endif
+
+#ifndef UGC_USE_WEAK
+#define UGC_USE_WEAK 0
+#endif
+
+#ifndef UGC_USE_EPOCHS
+#define UGC_USE_EPOCHS 0
+#endif
+
+#ifndef UGC_USE_LARGE
+#define UGC_USE_LARGE 0
+#endif
+
+#ifndef UGC_USE_REGIONS
+#define UGC_USE_REGIONS 0
+#endif
+
+#ifndef UGC_USE_FINALIZERS
+#define UGC_USE_FINALIZERS 0
+#endif
+
+#ifndef UGC_USE_EVACUATION
+#define UGC_USE_EVACUATION 0
+#endif
+
+#ifndef UGC_USE_SORT
+#define UGC_USE_SORT 0
+#endif
+
+#if UGC_USE_PERF && !UGC_USE_STATS
+#error "UGC_USE_PERF requires UGC_USE_STATS"
+#endif
+
+#if UGC_USE_PERF && !defined(__linux__)
+#error "UGC_USE_PERF is only supported on Linux"
+#endif
+
+#if UGC_USE_EPOCHS && !UGC_USE_THREADS
+#error "UGC_USE_EPOCHS requires UGC_USE_THREADS"
+#endif
+
+#if UGC_USE_EVACUATION && UGC_USE_THREADS
+#error "UGC_USE_EVACUATION is not supported with UGC_USE_THREADS"
+#endif
+
+#if UGC_USE_THREADS || UGC_USE_TRACE
+#include <stdatomic.h>
+#endif
+
+#if UGC_USE_CONSERVATIVE && UGC_USE_THREADS
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__ELF__) || defined(__APPLE__)) \
+	&& (defined(__x86_64__) || defined(__aarch64__)) && !defined(__ILP32__)
+// ugc_thread_block is written in assembly so that it saves the callee-saved
+// registers of its caller as is
+#define UGC_BLOCK_STUB 1
+#if defined(__x86_64__)
+#define UGC_BLOCK_NUM_REGISTERS 6
+#else
+#define UGC_BLOCK_NUM_REGISTERS 12
+#endif
+#else
+#define UGC_BLOCK_STUB 0
+#include <setjmp.h>
+#endif
+#endif
+
+#ifndef UGC_PIN_SCAN_CHUNK
+#define UGC_PIN_SCAN_CHUNK 256
+#endif
+
+#ifndef UGC_SORT_CHUNK
+#define UGC_SORT_CHUNK 64
+#endif
+
+#if UGC_USE_CONSERVATIVE && !defined(UGC_INDEX_GRANULE_SHIFT)
+#define UGC_INDEX_GRANULE_SHIFT 6
+#endif
+
+#if UGC_USE_RECORD && !defined(UGC_RECORD_BUFFER_SIZE)
+#define UGC_RECORD_BUFFER_SIZE 4096
+#endif
+
+#if UGC_USE_STATS
+
+#ifndef UGC_HISTOGRAM_SUB_BITS
+#define UGC_HISTOGRAM_SUB_BITS 4
+#endif
+
+#ifndef UGC_HISTOGRAM_MAX_BITS
+#define UGC_HISTOGRAM_MAX_BITS 40
+#endif
+
+#define UGC_HISTOGRAM_NUM_BUCKETS \
+	((UGC_HISTOGRAM_MAX_BITS - UGC_HISTOGRAM_SUB_BITS + 1) << UGC_HISTOGRAM_SUB_BITS)
+
+#endif
+
 typedef struct ugc_s ugc_t;
 typedef struct ugc_header_s ugc_header_t;
 
@@ -21,6 +170,73 @@ typedef struct ugc_header_s ugc_header_t;
  */
 typedef void(*ugc_visit_fn_t)(ugc_t* gc, ugc_header_t* obj);
 
+/// Output callback type.
+typedef void(*ugc_write_fn_t)(void* ctx, const void* data, size_t size);
+
+#if UGC_USE_EVACUATION
+/**
+ * @brief Evacuation callback type.
+ * @see ugc_t::evacuate_fn
+ */
+typedef ugc_header_t*(*ugc_move_fn_t)(ugc_t* gc, ugc_header_t* obj);
+#endif
+
+#if UGC_USE_PROFILE
+typedef struct ugc_profile_s ugc_profile_t;
+typedef struct ugc_profile_node_s ugc_profile_node_t;
+
+/**
+ * @brief Heap profiler callback type.
+ *
+ * It MUST set ugc_profile_node_t::type and ugc_profile_node_t::size for
+ * `node->obj`.
+ *
+ * @see ugc_profile_take
+ */
+typedef void(*ugc_describe_fn_t)(ugc_t* gc, ugc_profile_node_t* node);
+#endif
+
+#if UGC_USE_FIBERS
+typedef struct ugc_fiber_s ugc_fiber_t;
+
+/**
+ * @brief Fiber root scanning callback type.
+ * @see ugc_fiber_add
+ */
+typedef void(*ugc_fiber_scan_fn_t)(ugc_t* gc, ugc_fiber_t* fiber);
+#endif
+
+#if UGC_USE_WEAK
+typedef struct ugc_weak_s ugc_weak_t;
+#endif
+
+#if UGC_USE_LARGE
+typedef struct ugc_large_s ugc_large_t;
+#endif
+
+#if UGC_USE_REGIONS
+typedef struct ugc_region_s ugc_region_t;
+#endif
+
+#if UGC_USE_FINALIZERS
+typedef struct ugc_finalizable_s ugc_finalizable_t;
+#endif
+
+#if UGC_USE_THREADS
+typedef struct ugc_thread_s ugc_thread_t;
+typedef struct ugc_handle_s ugc_handle_t;
+typedef struct ugc_group_s ugc_group_t;
+#if UGC_USE_EPOCHS
+typedef struct ugc_reader_s ugc_reader_t;
+#endif
+
+/**
+ * @brief Thread root scanning callback type.
+ * @see ugc_thread_attach
+ */
+typedef void(*ugc_thread_scan_fn_t)(ugc_t* gc, ugc_thread_t* thread);
+#endif
+
 enum ugc_state_e
 {
 	UGC_IDLE,
@@ -28,6 +244,76 @@ enum ugc_state_e
 	UGC_SWEEP
 };
 
+/// Kind of work performed by a call to ugc_step.
+enum ugc_phase_e
+{
+	/// Initial scan of the root set, in UGC_IDLE state.
+	UGC_PHASE_ROOT,
+	/// Scan of a gray object.
+	UGC_PHASE_MARK,
+	/// Rescan of the root set at the end of UGC_MARK state.
+	UGC_PHASE_TERMINATION,
+	/// Release of a garbage object, or with UGC_USE_SORT, a sorting chunk.
+	UGC_PHASE_SWEEP,
+
+	UGC_PHASE_COUNT
+};
+
+#if UGC_USE_PERF
+/// Hardware performance counter.
+enum ugc_counter_e
+{
+	UGC_COUNTER_CYCLES,
+	UGC_COUNTER_INSTRUCTIONS,
+	/// Last level cache misses.
+	UGC_COUNTER_CACHE_MISSES,
+	UGC_COUNTER_BRANCH_MISSES,
+
+	UGC_COUNTER_COUNT
+};
+#endif
+
+#if UGC_USE_TRACE
+/// Kind of trace event.
+enum ugc_trace_type_e
+{
+	UGC_TRACE_CYCLE,
+	UGC_TRACE_ROOT_SCAN,
+	UGC_TRACE_MARK,
+	UGC_TRACE_TERMINATION,
+	UGC_TRACE_LARGE_SCAN,
+	UGC_TRACE_SWEEP,
+	UGC_TRACE_BARRIER,
+	UGC_TRACE_COLLECT_FULL
+};
+#endif
+
+#if UGC_USE_RECORD
+/// Kind of recorded operation.
+enum ugc_record_type_e
+{
+	/// ugc_register, ugc_register_local or ugc_register_chain on `obj`.
+	UGC_RECORD_REGISTER = 1,
+	/// ugc_write_barrier from `obj` to `child`.
+	UGC_RECORD_BARRIER_FORWARD,
+	/// ugc_write_barrier from `obj` to `child`.
+	UGC_RECORD_BARRIER_BACKWARD,
+	UGC_RECORD_STEP,
+	UGC_RECORD_COLLECT_FULL,
+	UGC_RECORD_RELEASE_ALL,
+	/// The root is being scanned. Following edges start from the root.
+	UGC_RECORD_SCAN_ROOTS,
+	/// `obj` is being scanned. Following edges start from `obj`.
+	UGC_RECORD_SCAN,
+	/// ugc_visit on `obj`.
+	UGC_RECORD_EDGE,
+	/// The root is being scanned again during mark termination, or pins are
+	/// being scanned. Following edges start from the root and add to the
+	/// ones of the last UGC_RECORD_SCAN_ROOTS.
+	UGC_RECORD_RESCAN_ROOTS
+};
+#endif
+
 enum ugc_barrier_direction_e
 {
 	UGC_BARRIER_FORWARD,
@@ -44,383 +330,4937 @@ struct ugc_header_s
 #endif
 };
 
+#if UGC_USE_FIBERS
 /**
- * @brief Garbage collector data
+ * @brief A separately scanned part of the root set, e.g: a coroutine stack.
  *
  * All fields MUST NOT be accessed unless stated otherwise.
+ *
+ * @see ugc_fiber_add
  */
-struct ugc_s
+struct ugc_fiber_s
 {
-	ugc_header_t set1, set2;
-	ugc_header_t *from, *to, *iterator;
-	ugc_visit_fn_t scan_fn, release_fn;
+	ugc_fiber_t* next;
+	ugc_fiber_t* prev;
+	ugc_fiber_scan_fn_t scan_fn;
+	unsigned char state;
 
 	/// Arbitrary userdata, not used by the library.
 	void* userdata;
-
-	/// Current state of the garbage collection. Read-only.
-	unsigned char state;
-	unsigned char white;
 };
+#endif
 
+#if UGC_USE_WEAK
 /**
- * @brief Initialize a GC.
+ * @brief A container of weak references, or of ephemerons.
  *
- * Two callbacks are required: one for scanning and the other for releasing.
- *
- * The scan callback must do the following:
+ * References in `refs` do not keep their targets alive. Once the mark phase
+ * is over, those to garbage are set to NULL.
  *
- * - If `obj` is NULL, it must call ugc_visit on all root objects.
- * - If `obj` is not NULL, it must call ugc_visit on all objects referenced by
- *   the given object.
+ * If `values` is not NULL, each `values[i]` is kept alive by `refs[i]`
+ * instead of by the object holding the container, and it is set to NULL
+ * along with `refs[i]`.
  *
- * The release callback will be invoked whenever the GC has determined that
- * an object has become garbage.
+ * @see ugc_weak_init
  */
-UGC_DECL void
-ugc_init(ugc_t* gc, ugc_visit_fn_t scan_fn, ugc_visit_fn_t release_fn);
+struct ugc_weak_s
+{
+	ugc_header_t** refs;
+	ugc_header_t** values;
+	size_t size;
+
+	/// Number of references set to NULL by the GC. It is never reset by the
+	/// library.
+	size_t num_cleared;
 
+	ugc_weak_t* next;
+};
+#endif
+
+#if UGC_USE_LARGE
 /**
- * @brief Release all allocated objects.
+ * @brief Header for a large object, e.g: a buffer or a big array.
  *
- * This is faster than clearing the root and forcing a full collection.
+ * All fields MUST NOT be accessed unless stated otherwise.
+ *
+ * @see ugc_register_large
  */
-UGC_DECL void
-ugc_release_all(ugc_t* gc);
+struct ugc_large_s
+{
+	ugc_header_t header;
+	ugc_large_t* next;
+	ugc_large_t* prev;
 
-/// Register a new object to be managed by the GC.
-UGC_DECL void
-ugc_register(ugc_t* gc, ugc_header_t* obj);
+	/// Size in bytes. Read-only.
+	size_t size;
+};
+#endif
 
+#if UGC_USE_REGIONS
 /**
- * @brief Execute a write barrier.
+ * @brief A set of objects which are expected to die together.
  *
- * Whenever an object stores a reference to another object, this function MUST
- * be called to ensure that the GC works correctly.
+ * All fields MUST NOT be accessed unless stated otherwise.
  *
- * Root objects (stack, globals) are treated differently so there is no need to
- * call this function when a store to them occurs.
+ * @see ugc_region_open
+ */
+struct ugc_region_s
+{
+	ugc_header_t objects;
+
+	/// Number of stores of an object of the region into an object outside of
+	/// it. Read-only.
+	size_t num_escapes;
+};
+#endif
+
+#if UGC_USE_FINALIZERS
+/**
+ * @brief Header for an object which needs to be finalized.
  *
- * @remarks Both objects MUST NOT be NULL.
+ * All fields MUST NOT be accessed.
+ *
+ * @see ugc_register_finalizable
  */
-UGC_DECL void
-ugc_write_barrier(
-	ugc_t* gc,
-	enum ugc_barrier_direction_e direction,
-	ugc_header_t* parent,
-	ugc_header_t* child
-);
+struct ugc_finalizable_s
+{
+	ugc_header_t header;
+	ugc_finalizable_t* next;
+	ugc_finalizable_t* prev;
+};
+#endif
 
+#if UGC_USE_THREADS
 /**
- * @brief Make the GC perform one unit of work.
+ * @brief Mutator thread data.
  *
- * What happens depends on the current GC's state.
+ * All fields MUST NOT be accessed unless stated otherwise.
+ */
+struct ugc_thread_s
+{
+	ugc_thread_t* next;
+	ugc_thread_t* prev;
+	ugc_thread_scan_fn_t scan_fn;
+	ugc_header_t local;
+	atomic_int state;
+	ugc_t* gc;
+
+#if UGC_USE_CONSERVATIVE
+	/// Highest address of the thread's stack (e.g: from
+	/// `pthread_getattr_np`). MUST be set before ugc_scan_thread is called.
+	const void* stack_base;
+	const void* stack_top;
+#if UGC_BLOCK_STUB
+	uintptr_t registers[UGC_BLOCK_NUM_REGISTERS];
+#else
+	jmp_buf registers;
+#endif
+#endif
+
+	/// Arbitrary userdata, not used by the library.
+	void* userdata;
+};
+
+/**
+ * @brief A reference to an object held from outside its GC.
  *
- * - In UGC_IDLE state, it will scan the root by calling the scan callback then
- *   switch to UGC_MARK state.
- * - In UGC_MARK state, it will mark one object and discover its children using
- *   the scan callback. When there is no object left to mark, the GC will scan
- *   the root once more to account for changes during the mark phase. When all
- *   live objects are marked, it will switch to UGC_SWEEP state.
- * - In UGC_SWEEP state, it will release one object. When all garbage are
- *   released, it wil switch to UGC_IDLE state.
+ * All fields MUST NOT be accessed unless stated otherwise.
  *
- * @see ugc_init
+ * @see ugc_handle_set
  */
-UGC_DECL void
-ugc_step(ugc_t* gc);
+struct ugc_handle_s
+{
+	ugc_handle_t* next;
+	ugc_handle_t* prev;
 
+	/// The referenced object. Read-only.
+	ugc_header_t* target;
+};
 
 /**
- * @brief Perform a collection cycle.
+ * @brief A set of GCs which are collected by a pool of threads.
  *
- * Start the GC if it's not already running and only return once the GC has
- * finished collecting all garbage identified at the point of calling.
+ * All fields MUST NOT be accessed.
  *
- * @remarks If the GC is already in the UGC_SWEEP state, it will leave newly
- * created garbage for the next cycle.
+ * @see ugc_group_init
  */
-UGC_DECL void
-ugc_collect(ugc_t* gc);
+struct ugc_group_s
+{
+	ugc_t** heaps;
+	size_t num_heaps;
+	atomic_size_t cursor;
+};
+#endif
 
+#if UGC_USE_EPOCHS
 /**
- * @brief Inform the GC of a referred object during the mark phase.
+ * @brief A thread reading managed objects without synchronizing with the GC.
  *
- * @remarks This function MUST ONLY be called inside the scan callback.
- * @remarks The provided object MUST NOT be NULL.
- * @see ugc_init
+ * All fields MUST NOT be accessed.
+ *
+ * @see ugc_reader_attach
  */
-UGC_DECL void
-ugc_visit(ugc_t* gc, ugc_header_t* obj);
+struct ugc_reader_s
+{
+	ugc_reader_t* next;
+	ugc_reader_t* prev;
+	/// Epoch at the start of the current read section, 0 outside of one.
+	atomic_uintptr_t epoch;
+};
+#endif
 
-#ifdef UGC_IMPLEMENTATION
+#if UGC_USE_TRACE
+/**
+ * @brief A trace event.
+ *
+ * `phase` follows the Chrome trace event format: 'B' (begin), 'E' (end), 'X'
+ * (complete, with a duration) or 'i' (instant). Times are in nanoseconds.
+ */
+typedef struct ugc_trace_event_s
+{
+	atomic_size_t sequence;
+	uint64_t timestamp;
+	uint64_t duration;
+	unsigned char type;
+	char phase;
+} ugc_trace_event_t;
+#endif
 
-#define UGC_GRAY 2
+#if UGC_USE_RECORD
+/**
+ * @brief A recorded operation.
+ *
+ * Objects are identified by their address divided by the alignment of
+ * ugc_header_t.
+ */
+typedef struct ugc_record_op_s
+{
+	enum ugc_record_type_e type;
+	uintptr_t obj;
+	uintptr_t child;
+} ugc_record_op_t;
 
-#if UGC_USE_TAGGED_POINTER
+/// Decoder for a recording.
+typedef struct ugc_record_reader_s
+{
+	const unsigned char* data;
+	const unsigned char* end;
+	uintptr_t last;
+} ugc_record_reader_t;
+#endif
 
-#define UGC_PTR(ptr) ((uintptr_t)ptr & (~0x03))
-#define UGC_TAG(ptr) ((uintptr_t)ptr & 0x03)
-#define UGC_SET_PTR(ptr, val) \
-	do { ptr = (ugc_header_t*)((uintptr_t)val | UGC_TAG(ptr)); } while(0)
-#define UGC_SET_TAG(ptr, val) \
-	do { ptr = (ugc_header_t*)(UGC_PTR(ptr) | (uintptr_t)val); } while(0)
+#if UGC_USE_LAYOUT
+/**
+ * @brief A range of pointers.
+ * @see ugc_layout_t
+ */
+typedef struct ugc_layout_range_s
+{
+	/// Offset of the first pointer or, if `indirect` is set, of a pointer to
+	/// the first pointer.
+	size_t offset;
+	/// Offset of a `size_t` field holding the number of pointers.
+	size_t length_offset;
+	int indirect;
+} ugc_layout_range_t;
+
+/**
+ * @brief Description of the pointers in an object.
+ *
+ * Offsets are relative to the header. Pointers MUST either be NULL or point to
+ * a ugc_header_t.
+ *
+ * @see ugc_t::layout_offset
+ */
+typedef struct ugc_layout_s
+{
+	const size_t* fields;
+	size_t num_fields;
+	const ugc_layout_range_t* ranges;
+	size_t num_ranges;
+} ugc_layout_t;
+#endif
+
+#if UGC_USE_CONSERVATIVE
+/**
+ * @brief An entry of an address index.
+ * @see ugc_index_t
+ */
+typedef struct ugc_index_entry_s
+{
+	/// Number of the granule plus one, 0 for an empty entry.
+	uintptr_t key;
+	ugc_header_t* obj;
+	size_t size;
+} ugc_index_entry_t;
+
+/**
+ * @brief Map from addresses to the objects containing them.
+ *
+ * The address space is divided in granules of `1 << UGC_INDEX_GRANULE_SHIFT`
+ * bytes. An object has an entry for each granule it overlaps in a hash table,
+ * which is kept at most 3/4 full.
+ *
+ * All fields MUST NOT be accessed unless stated otherwise.
+ *
+ * @see ugc_index_init
+ */
+typedef struct ugc_index_s
+{
+	ugc_index_entry_t* entries;
+	size_t mask;
+	unsigned int shift;
+	/// Number of used entries. Read-only.
+	size_t num_entries;
+	/// Bounds of all objects ever added, to quickly reject most other words.
+	uintptr_t min, max;
+} ugc_index_t;
+#endif
+
+#if UGC_USE_PROFILE
+/// An object in a heap profile.
+struct ugc_profile_node_s
+{
+	/// The object, NULL for the root.
+	ugc_header_t* obj;
+	/// User-supplied type tag.
+	unsigned int type;
+	/// User-supplied size.
+	size_t size;
+	/// Sum of the sizes of the objects which are only reachable through this one,
+	/// including itself.
+	size_t retained;
+	/// Index of the immediate dominator: the closest node through which all
+	/// paths from the root to this one go.
+	size_t dominator;
+	/// Outgoing edges: ugc_profile_t::edges[first_edge .. first_edge + num_edges].
+	size_t first_edge;
+	size_t num_edges;
+
+	ugc_header_t* prev;
+};
+
+/// Live objects of a given type in a heap profile.
+typedef struct ugc_profile_type_s
+{
+	size_t count;
+	size_t size;
+	/// Retained size of objects whose immediate dominator has a different type.
+	size_t retained;
+} ugc_profile_type_t;
+
+/**
+ * @brief Snapshot of the object graph.
+ *
+ * The profiler does not allocate, nodes and edges are stored in
+ * caller-provided arrays.
+ *
+ * @see ugc_profile_init
+ */
+struct ugc_profile_s
+{
+	/// Reachable objects in breadth-first order, starting with the root.
+	ugc_profile_node_t* nodes;
+	size_t num_nodes;
+	size_t max_nodes;
+
+	/// Index of the target node of each edge.
+	size_t* edges;
+	size_t num_edges;
+	size_t max_edges;
+
+	size_t current;
+	int overflow;
+};
+#endif
+
+#if UGC_USE_STATS
+/**
+ * @brief Log-linear histogram of durations in nanoseconds.
+ *
+ * Each power of two is divided into 2^UGC_HISTOGRAM_SUB_BITS buckets.
+ * Durations longer than 2^UGC_HISTOGRAM_MAX_BITS are counted in the last
+ * bucket.
+ *
+ * @see ugc_histogram_percentile
+ */
+typedef struct ugc_histogram_s
+{
+	uint64_t count;
+	uint64_t total;
+	uint64_t max;
+	uint64_t buckets[UGC_HISTOGRAM_NUM_BUCKETS];
+} ugc_histogram_t;
+
+/// Timing statistics. All durations are in nanoseconds.
+typedef struct ugc_stats_s
+{
+	/// Duration of ugc_step calls, by phase.
+	ugc_histogram_t steps[UGC_PHASE_COUNT];
+
+#if UGC_USE_PERF
+	/// Hardware counters accumulated during ugc_step calls, by phase.
+	/// Counters which could not be opened stay at 0.
+	/// @see ugc_perf_open
+	uint64_t counters[UGC_PHASE_COUNT][UGC_COUNTER_COUNT];
+#endif
+
+	/// Number of finished cycles.
+	uint64_t num_cycles;
+	/// Time spent collecting during the last finished cycle.
+	uint64_t last_cycle_work;
+	/// Time between the start and the end of the last finished cycle.
+	uint64_t last_cycle_duration;
+	/// Sum of ugc_stats_t::last_cycle_work over all finished cycles.
+	uint64_t total_cycle_work;
+	/// Sum of ugc_stats_t::last_cycle_duration over all finished cycles.
+	uint64_t total_cycle_duration;
+
+	uint64_t cycle_start;
+	uint64_t cycle_work;
+} ugc_stats_t;
+#endif
+
+/**
+ * @brief Garbage collector data
+ *
+ * All fields MUST NOT be accessed unless stated otherwise.
+ */
+struct ugc_s
+{
+	ugc_header_t set1, set2;
+	ugc_header_t *from, *to, *iterator;
+	ugc_visit_fn_t scan_fn, release_fn;
+
+	/// Arbitrary userdata, not used by the library.
+	void* userdata;
+
+	/// Current state of the garbage collection. Read-only.
+	unsigned char state;
+	unsigned char white;
+
+#if UGC_USE_FIBERS
+	ugc_fiber_t dirty_fibers;
+	ugc_fiber_t clean_fibers;
+#endif
+
+#if UGC_USE_PINS
+	uintptr_t* pin_slots;
+	size_t pin_capacity;
+	size_t pin_size;
+	size_t pin_free;
+	size_t pin_cursor;
+#endif
+
+#if UGC_USE_WEAK
+	ugc_weak_t* weak_list;
+#endif
+
+#if UGC_USE_REGIONS
+	/// The open region, if any. Read-only.
+	ugc_region_t* region;
+#endif
+
+#if UGC_USE_FINALIZERS
+	/// Called by ugc_finalize on each queued object. It MUST be set before
+	/// objects are finalized.
+	ugc_visit_fn_t finalize_fn;
+	/// Number of objects in the finalization queue. Read-only.
+	size_t num_finalizers;
+
+	ugc_finalizable_t finalizable;
+	ugc_finalizable_t finalize_queue;
+#endif
+
+#if UGC_USE_SORT
+	/// Number of cycles between two sorts of the surviving objects by address,
+	/// 0 to never sort them. Default: 8.
+	unsigned int sort_period;
+
+	unsigned int sort_cycles;
+	ugc_header_t sort_list;
+	ugc_header_t* sort_a;
+	ugc_header_t* sort_b;
+	size_t sort_na;
+	size_t sort_nb;
+	size_t sort_width;
+	unsigned char sort_phase;
+	unsigned char sort_merged;
+#endif
+
+#if UGC_USE_EVACUATION
+	/// Called on each live object once the mark phase is complete. It returns
+	/// a copy of the whole object, header included, or NULL to leave it in
+	/// place. Objects registered with ugc_register_large or
+	/// ugc_register_finalizable, or added to an index, MUST NOT be moved.
+	/// Default: NULL, nothing is moved.
+	ugc_move_fn_t evacuate_fn;
+	/// Called on each live object, then with NULL for the roots, once
+	/// objects were moved. It MUST replace every reference, including those
+	/// in weak containers, with the result of ugc_forward. Default: NULL.
+	ugc_visit_fn_t relocate_fn;
+	/// Number of objects moved at the end of the last mark phase. Read-only.
+	size_t num_evacuated;
+#endif
+
+#if UGC_USE_LARGE
+	ugc_large_t large_objects;
+	/// Total size of the large objects. Read-only.
+	size_t large_size;
+	/// Size of the large objects registered since the start of the current
+	/// or last cycle. Read-only.
+	size_t large_registered;
+#endif
+
+#if UGC_USE_THREADS
+	ugc_thread_t* threads;
+	ugc_handle_t handles;
+	atomic_flag thread_lock;
+	atomic_flag heap_lock;
+	atomic_int safepoint;
+
+	/// Number of steps performed in each round of ugc_group_step.
+	unsigned int budget;
+#endif
+
+#if UGC_USE_EPOCHS
+	ugc_reader_t readers;
+	atomic_size_t num_readers;
+	atomic_uintptr_t epoch;
+	ugc_header_t* limbo[3];
+#endif
+
+#if UGC_USE_STATS
+	/// Timing statistics. Read-only.
+	ugc_stats_t stats;
+#endif
+
+#if UGC_USE_CONSERVATIVE
+	/// Index used by conservative scans. Objects are removed from it before
+	/// being released. It MUST NOT be shared with another GC.
+	/// Default: NULL.
+	ugc_index_t* index;
+#endif
+
+#if UGC_USE_LAYOUT
+	/// Offset of a `const ugc_layout_t*` in every object, relative to the
+	/// header. Objects are traced according to their layout instead of being
+	/// passed to the scan callback, unless it is NULL. Default: 0 (disabled).
+	size_t layout_offset;
+#endif
+
+#if UGC_USE_PACER
+	/// Longest increment of ugc_pace in nanoseconds. Default: 500000.
+	uint64_t pause_target;
+	/// Fraction of the time ugc_pace aims to spend collecting, in [0, 1).
+	/// It is clamped to [0, 0.99]. Default: 0.25.
+	double cpu_share;
+
+#if UGC_USE_LARGE
+	/// ugc_pace starts a cycle regardless of cpu_share once ugc_t::large_registered
+	/// reaches this size. Default: 64 MiB.
+	size_t large_trigger;
+#endif
+
+	uint64_t step_cost[UGC_PHASE_COUNT];
+	uint64_t pace_end;
+	int64_t pace_credit;
+	size_t num_registered;
+#endif
+
+#if UGC_USE_PERF
+	int perf_fds[UGC_COUNTER_COUNT];
+#endif
+
+#if UGC_USE_PROFILE
+	ugc_profile_t* profile;
+#endif
+
+#if UGC_USE_RECORD
+	ugc_write_fn_t record_fn;
+	void* record_ctx;
+	uintptr_t record_last;
+	size_t record_size;
+	unsigned char record_buf[UGC_RECORD_BUFFER_SIZE];
+#endif
+
+#if UGC_USE_TRACE
+	ugc_trace_event_t* trace_events;
+	size_t trace_mask;
+	atomic_size_t trace_head;
+
+	/// Scans of a single object taking at least this long (in nanoseconds)
+	/// are traced. Default: 100000.
+	uint64_t trace_threshold;
+#endif
+};
+
+/**
+ * @brief Initialize a GC.
+ *
+ * Two callbacks are required: one for scanning and the other for releasing.
+ *
+ * The scan callback must do the following:
+ *
+ * - If `obj` is NULL, it must call ugc_visit on all root objects.
+ * - If `obj` is not NULL, it must call ugc_visit on all objects referenced by
+ *   the given object.
+ *
+ * The release callback will be invoked whenever the GC has determined that
+ * an object has become garbage.
+ */
+UGC_DECL void
+ugc_init(ugc_t* gc, ugc_visit_fn_t scan_fn, ugc_visit_fn_t release_fn);
+
+/**
+ * @brief Release all allocated objects.
+ *
+ * This is faster than clearing the root and forcing a full collection.
+ */
+UGC_DECL void
+ugc_release_all(ugc_t* gc);
+
+/// Register a new object to be managed by the GC.
+UGC_DECL void
+ugc_register(ugc_t* gc, ugc_header_t* obj);
+
+/**
+ * @brief Initialize a chain of objects to be registered together.
+ *
+ * `chain` is only used as the list head, it is not an object.
+ * The chain becomes empty after ugc_register_chain and must be initialized
+ * again before reuse.
+ *
+ * @see ugc_register_chain
+ */
+UGC_DECL void
+ugc_chain_init(ugc_t* gc, ugc_header_t* chain);
+
+/// Append a new object to a chain.
+UGC_DECL void
+ugc_chain_push(ugc_header_t* chain, ugc_header_t* obj);
+
+/**
+ * @brief Register all objects in a chain.
+ *
+ * This takes constant time unless the GC has finished a mark phase since
+ * ugc_chain_init and is currently in UGC_SWEEP state.
+ *
+ * @remarks Objects registered this way during the mark phase of a cycle which
+ * started after ugc_chain_init will survive that cycle.
+ */
+UGC_DECL void
+ugc_register_chain(ugc_t* gc, ugc_header_t* chain);
+
+/**
+ * @brief Move all objects from `src` into `dst`.
+ *
+ * If `src` is in UGC_SWEEP state, its sweep phase is finished first. Any
+ * mark phase in progress in `src` is abandoned. `src` is left empty and in
+ * UGC_IDLE state.
+ *
+ * This takes constant time unless `dst` is in UGC_SWEEP state and the
+ * colors of the two GCs do not agree.
+ *
+ * @remarks Both GCs should use the same callbacks since objects from `src`
+ * will be scanned and released with those of `dst`.
+ * @remarks Moved objects might survive the current or next cycle of `dst`.
+ * @remarks When UGC_USE_THREADS is enabled, `src` MUST NOT have any attached
+ * thread or set handle.
+ * @remarks When UGC_USE_CONSERVATIVE is enabled, the objects in the index of
+ * `src` are moved to the index of `dst`, which MUST have room for them.
+ * Objects which do not fit are not found by conservative scans of `dst`.
+ */
+UGC_DECL void
+ugc_merge(ugc_t* dst, ugc_t* src);
+
+/**
+ * @brief Execute a write barrier.
+ *
+ * Whenever an object stores a reference to another object, this function MUST
+ * be called to ensure that the GC works correctly.
+ *
+ * Root objects (stack, globals) are treated differently so there is no need to
+ * call this function when a store to them occurs.
+ *
+ * @remarks Both objects MUST NOT be NULL.
+ */
+UGC_DECL void
+ugc_write_barrier(
+	ugc_t* gc,
+	enum ugc_barrier_direction_e direction,
+	ugc_header_t* parent,
+	ugc_header_t* child
+);
+
+/**
+ * @brief Make the GC perform one unit of work.
+ *
+ * What happens depends on the current GC's state.
+ *
+ * - In UGC_IDLE state, it will scan the root by calling the scan callback then
+ *   switch to UGC_MARK state.
+ * - In UGC_MARK state, it will mark one object and discover its children using
+ *   the scan callback. When there is no object left to mark, the GC will scan
+ *   the root once more to account for changes during the mark phase. When all
+ *   live objects are marked, it will switch to UGC_SWEEP state.
+ * - In UGC_SWEEP state, it will release one object. When all garbage are
+ *   released, it wil switch to UGC_IDLE state.
+ *
+ * @see ugc_init
+ */
+UGC_DECL void
+ugc_step(ugc_t* gc);
+
+
+/**
+ * @brief Perform a collection cycle.
+ *
+ * Start the GC if it's not already running and only return once the GC has
+ * finished collecting all garbage identified at the point of calling.
+ *
+ * @remarks If the GC is already in the UGC_SWEEP state, it will leave newly
+ * created garbage for the next cycle.
+ */
+UGC_DECL void
+ugc_collect(ugc_t* gc);
+
+#if UGC_USE_PACER
+
+/**
+ * @brief Perform an increment sized to meet a pause target and a CPU share.
+ *
+ * Call it regularly (e.g: after each allocation or once per frame) instead of
+ * ugc_step. The cost of steps is measured separately for each phase, which
+ * is used to make as many steps as fit in an increment:
+ *
+ * - The time between two increments earns the collector
+ *   `cpu_share / (1 - cpu_share)` of it.
+ * - During a cycle, allocation also earns it enough time to scan and release
+ *   every object registered since the last increment. This takes precedence
+ *   over the CPU share since a collector which falls behind never finishes
+ *   marking.
+ * - Once mark termination has started, the increment can use the whole pause
+ *   target to finish it.
+ * - No increment is longer than ugc_t::pause_target, unless a single step is.
+ *
+ * A new cycle is only started once objects were registered and enough time
+ * was earned for a root scan, or with UGC_USE_LARGE, once
+ * ugc_t::large_trigger is reached.
+ *
+ * @remarks Objects registered with ugc_register_local or ugc_register_chain
+ * are not accounted for.
+ */
+UGC_DECL void
+ugc_pace(ugc_t* gc);
+
+#endif
+
+/**
+ * @brief Reclaim all garbage.
+ *
+ * Unlike ugc_collect, this guarantees that all objects which are unreachable
+ * at the point of calling are released, regardless of the current state.
+ * It is meant for emergencies (e.g: an allocation failure) and does the least
+ * amount of work to achieve that:
+ *
+ * - In UGC_SWEEP state, the current sweep phase is finished.
+ * - In UGC_MARK state, the current mark phase is abandoned.
+ * - A full cycle is then performed without interruption, scanning the root only
+ *   once.
+ *
+ * The GC is in UGC_IDLE state upon return.
+ *
+ * @see UGC_TRY_ALLOC
+ */
+UGC_DECL void
+ugc_collect_full(ugc_t* gc);
+
+/**
+ * @brief Retry an allocation after reclaiming all garbage.
+ *
+ * Assign the result of `expr` to `ptr`. If it is NULL, call ugc_collect_full
+ * then evaluate `expr` once more:
+ *
+ * @code
+ * my_obj_t* obj;
+ * UGC_TRY_ALLOC(gc, obj, malloc(sizeof(my_obj_t)));
+ * if(obj == NULL) { panic(); }
+ * @endcode
+ *
+ * @remarks `expr` can be evaluated twice.
+ */
+#define UGC_TRY_ALLOC(gc, ptr, expr) \
+	do { \
+		(ptr) = (expr); \
+		if((ptr) == NULL) { ugc_collect_full(gc); (ptr) = (expr); } \
+	} while(0)
+
+/**
+ * @brief Inform the GC of a referred object during the mark phase.
+ *
+ * @remarks This function MUST ONLY be called inside the scan callback.
+ * @remarks The provided object MUST NOT be NULL.
+ * @see ugc_init
+ */
+UGC_DECL void
+ugc_visit(ugc_t* gc, ugc_header_t* obj);
+
+#if UGC_USE_FIBERS
+
+/**
+ * @brief Add a fiber to the root set.
+ *
+ * `scan_fn` must call ugc_visit on all roots owned by the fiber (e.g: its
+ * stack). During a cycle, it is called once at the start of the mark phase
+ * then only during the rescans of mark termination which follow a
+ * ugc_fiber_resume.
+ *
+ * @remarks `fiber` MUST stay valid until ugc_fiber_remove is called.
+ */
+UGC_DECL void
+ugc_fiber_add(ugc_t* gc, ugc_fiber_t* fiber, ugc_fiber_scan_fn_t scan_fn);
+
+/// Remove a fiber from the root set.
+UGC_DECL void
+ugc_fiber_remove(ugc_t* gc, ugc_fiber_t* fiber);
+
+/**
+ * @brief Mark a fiber as running.
+ *
+ * A running fiber is rescanned on every mark termination attempt, until
+ * ugc_fiber_suspend is called. This MUST be called before the roots of a
+ * fiber are modified, even by another fiber.
+ *
+ * @remarks Only the first call since the fiber was last scanned takes a lock
+ * with UGC_USE_THREADS.
+ */
+UGC_DECL void
+ugc_fiber_resume(ugc_t* gc, ugc_fiber_t* fiber);
+
+/// Mark a fiber as suspended. It will be rescanned at most once more.
+UGC_DECL void
+ugc_fiber_suspend(ugc_t* gc, ugc_fiber_t* fiber);
+
+#endif
+
+#if UGC_USE_PINS
+
+/**
+ * @brief Set the storage of the pin table.
+ *
+ * Pinned objects are part of the root set. The table is scanned
+ * incrementally, UGC_PIN_SCAN_CHUNK slots per ugc_step, once there are no
+ * gray objects left.
+ *
+ * @param slots Storage for the table, it is not owned by the GC.
+ * @param capacity Maximum number of pinned objects.
+ * @remarks Pins are not moved by ugc_merge, `src` MUST NOT have any.
+ */
+UGC_DECL void
+ugc_pins_init(ugc_t* gc, uintptr_t* slots, size_t capacity);
+
+/**
+ * @brief Keep an object alive until ugc_unpin is called.
+ *
+ * During the mark phase, the object is made gray so that the table does not
+ * need to be scanned again.
+ *
+ * @return A slot number, or SIZE_MAX if the table is full.
+ */
+UGC_DECL size_t
+ugc_pin(ugc_t* gc, ugc_header_t* obj);
+
+/// Release a slot returned by ugc_pin.
+UGC_DECL void
+ugc_unpin(ugc_t* gc, size_t slot);
+
+/// Get the object pinned in a slot.
+UGC_DECL ugc_header_t*
+ugc_pinned(ugc_t* gc, size_t slot);
+
+#endif
+
+#if UGC_USE_WEAK
+
+/**
+ * @brief Initialize a weak container.
+ *
+ * `refs`, `values` and `size` can be modified at any time, e.g: when the
+ * container grows.
+ *
+ * @param values NULL for plain weak references.
+ */
+UGC_DECL void
+ugc_weak_init(ugc_weak_t* weak, ugc_header_t** refs, ugc_header_t** values, size_t size);
+
+/**
+ * @brief Inform the GC of a weak container during the mark phase.
+ *
+ * Only visited containers are cleared so the cost of weak references is
+ * proportional to the size of the live containers, not of the heap.
+ *
+ * @remarks This function MUST ONLY be called inside the scan callback.
+ * @remarks A visited container MUST stay valid until the end of the mark
+ * phase. This is the case when it is part of the scanned object.
+ */
+UGC_DECL void
+ugc_visit_weak(ugc_t* gc, ugc_weak_t* weak);
+
+#endif
+
+#if UGC_USE_LARGE
+
+/**
+ * @brief Register a new large object.
+ *
+ * Large objects are marked like any other object but they are also kept in
+ * a separate list along with their size. Garbage among them is released as
+ * soon as the mark phase ends, before the sweep phase starts, so that big
+ * allocations are returned early. The release callback receives
+ * `&obj->header`.
+ *
+ * @param size Size in bytes, only used for accounting.
+ */
+UGC_DECL void
+ugc_register_large(ugc_t* gc, ugc_large_t* obj, size_t size);
+
+#endif
+
+#if UGC_USE_REGIONS
+
+/**
+ * @brief Start a region, e.g: at the start of a request.
+ *
+ * Objects registered with ugc_register_region are neither marked nor swept:
+ * they are kept alive until the region is closed and the objects they refer
+ * to are treated as roots. Write barriers count the stores of a region object
+ * into an object outside of the region.
+ *
+ * Escapes are only seen through the write barrier: ugc_write_barrier MUST
+ * also be called for the initializing stores into freshly allocated objects,
+ * whether they are region objects or not.
+ *
+ * @remarks Only one region can be open at a time in a GC. It MUST NOT be
+ * open during ugc_merge.
+ */
+UGC_DECL void
+ugc_region_open(ugc_t* gc, ugc_region_t* region);
+
+/**
+ * @brief Register a new object in the open region.
+ *
+ * During the mark phase, the object is scanned right away.
+ */
+UGC_DECL void
+ugc_register_region(ugc_t* gc, ugc_header_t* obj);
+
+/**
+ * @brief Close the open region.
+ *
+ * If no object of the region escaped, all of them are released at once.
+ * Otherwise, they are handed over to the GC like newly registered objects.
+ * With UGC_USE_WEAK, this is also the case during the mark phase since the
+ * objects may hold weak containers which were visited.
+ *
+ * @remarks References from roots, handles, pins and weak containers are not
+ * tracked. Those MUST be dropped before the region is closed.
+ * @return 1 if the objects were released, 0 otherwise.
+ */
+UGC_DECL int
+ugc_region_close(ugc_t* gc);
+
+#endif
+
+#if UGC_USE_FINALIZERS
+
+/**
+ * @brief Register a new object which must be finalized before being released.
+ *
+ * Once it is found to be garbage at the end of a mark phase, the object is
+ * kept alive, along with everything it refers to, and moved to the
+ * finalization queue. It is released by a later cycle once ugc_finalize has
+ * passed it to ugc_t::finalize_fn and it is unreachable again.
+ *
+ * @remarks Weak references to the object are only cleared by the cycle which
+ * releases it.
+ * @remarks Queued objects are released by ugc_release_all without being
+ * finalized.
+ */
+UGC_DECL void
+ugc_register_finalizable(ugc_t* gc, ugc_finalizable_t* obj);
+
+/**
+ * @brief Finalize queued objects.
+ *
+ * This can be called at any time outside of a callback, e.g: when the
+ * mutator is idle.
+ *
+ * @param max_objects Maximum number of objects to finalize.
+ * @return Number of finalized objects.
+ */
+UGC_DECL size_t
+ugc_finalize(ugc_t* gc, size_t max_objects);
+
+#endif
+
+#if UGC_USE_EVACUATION
+
+/**
+ * @brief Get the new location of an object.
+ *
+ * The original of a moved object keeps a forwarding pointer to its copy
+ * until the evacuation ends. Other objects are returned as is.
+ *
+ * @remarks This function MUST ONLY be called inside ugc_t::relocate_fn.
+ * @remarks The provided object MUST NOT be NULL.
+ */
+UGC_DECL ugc_header_t*
+ugc_forward(ugc_t* gc, ugc_header_t* obj);
+
+#endif
+
+#if UGC_USE_CONSERVATIVE
+
+/**
+ * @brief Initialize an address index.
+ *
+ * @param entries Storage for the index, it is not owned by the index.
+ * @param capacity Number of entries, MUST be a power of 2 and at least 2.
+ */
+UGC_DECL void
+ugc_index_init(ugc_index_t* index, ugc_index_entry_t* entries, size_t capacity);
+
+/**
+ * @brief Add an object to an index.
+ *
+ * The object MUST already be registered and MUST NOT already be in the index.
+ *
+ * @param size Size of the object in bytes, including its header.
+ * @return 0 on success, -1 if the index is too full.
+ */
+UGC_DECL int
+ugc_index_add(ugc_index_t* index, ugc_header_t* obj, size_t size);
+
+/**
+ * @brief Remove an object from an index.
+ *
+ * This is done by the GC before releasing an object. Nothing happens if the
+ * object is not in the index.
+ */
+UGC_DECL void
+ugc_index_remove(ugc_index_t* index, ugc_header_t* obj);
+
+/**
+ * @brief Find the object containing an address.
+ *
+ * @return The object whose `size` bytes starting at its header contain `ptr`,
+ * or NULL.
+ */
+UGC_DECL ugc_header_t*
+ugc_index_find(const ugc_index_t* index, const void* ptr);
+
+/**
+ * @brief Visit all objects pointed to by the words of a memory range.
+ *
+ * Each aligned word which points into an object of ugc_t::index is treated
+ * as a reference to that object.
+ *
+ * @remarks This MUST ONLY be called inside the scan callback.
+ */
+UGC_DECL void
+ugc_scan_range(ugc_t* gc, const void* begin, const void* end);
+
+/**
+ * @brief Visit all objects pointed to by the stack and registers of the
+ * calling thread.
+ *
+ * Callee-saved registers are spilled to the stack, which is then scanned up
+ * to `stack_base` with ugc_scan_range.
+ *
+ * @param stack_base Highest address of the stack (e.g: the address of a local
+ * variable in `main`).
+ * @remarks This MUST ONLY be called inside the scan callback.
+ */
+UGC_DECL void
+ugc_scan_stack(ugc_t* gc, const void* stack_base);
+
+#endif
+
+#if UGC_USE_STATS
+
+/**
+ * @brief Get a percentile of a histogram.
+ *
+ * The nearest-rank method is used: the result is the smallest recorded
+ * value which is at least as large as `ceil(percentile * count)` values.
+ *
+ * @param percentile A number between 0 and 1 (e.g: 0.99).
+ * @return The upper bound of the bucket containing the requested percentile,
+ * capped at the maximum recorded value.
+ */
+UGC_DECL uint64_t
+ugc_histogram_percentile(const ugc_histogram_t* histogram, double percentile);
+
+/// Clear all statistics.
+UGC_DECL void
+ugc_stats_reset(ugc_t* gc);
+
+#endif
+
+#if UGC_USE_PERF
+
+/**
+ * @brief Start sampling hardware counters around ugc_step.
+ *
+ * Counters are opened with `perf_event_open` for the calling thread and
+ * only count user-space events. Counters which are not supported by the
+ * hardware are skipped.
+ *
+ * @remarks ugc_step MUST be called from the same thread afterwards.
+ * @return 0 if at least one counter was opened, -1 otherwise (`errno` is
+ * set). A common cause of failure is `/proc/sys/kernel/perf_event_paranoid`.
+ * @see ugc_stats_t::counters
+ */
+UGC_DECL int
+ugc_perf_open(ugc_t* gc);
+
+/// Stop sampling hardware counters.
+UGC_DECL void
+ugc_perf_close(ugc_t* gc);
+
+#endif
+
+#if UGC_USE_TRACE
+
+/**
+ * @brief Start recording trace events into a ring buffer.
+ *
+ * Once full, the oldest events are overwritten. Recording is lock-free so
+ * barriers from several threads can record events concurrently.
+ *
+ * @param capacity Number of events in `events`. MUST be a power of 2.
+ * Passing 0 stops recording.
+ */
+UGC_DECL void
+ugc_trace_init(ugc_t* gc, ugc_trace_event_t* events, size_t capacity);
+
+/**
+ * @brief Write the recorded events in the Chrome trace event JSON format.
+ *
+ * The output can be loaded in chrome://tracing or Perfetto. Events which are
+ * being overwritten while dumping are skipped.
+ */
+UGC_DECL void
+ugc_trace_dump(ugc_t* gc, ugc_write_fn_t write_fn, void* ctx);
+
+#endif
+
+#if UGC_USE_RECORD
+
+/**
+ * @brief Start recording operations.
+ *
+ * Calls to ugc_register, ugc_write_barrier, ugc_step, ugc_collect_full and
+ * ugc_release_all are written to `write_fn` in a compact binary format, along
+ * with the edges reported by ugc_visit during each scan. Together, they are
+ * enough to replay the workload against a synthetic object graph.
+ *
+ * Output is buffered, ugc_record_stop flushes it.
+ *
+ * @remarks Recording is not thread-safe, recorded calls MUST be serialized.
+ * @remarks ugc_merge is not recorded.
+ * @see ugc_record_read
+ */
+UGC_DECL void
+ugc_record_start(ugc_t* gc, ugc_write_fn_t write_fn, void* ctx);
+
+/// Write buffered operations.
+UGC_DECL void
+ugc_record_flush(ugc_t* gc);
+
+/// Flush and stop recording.
+UGC_DECL void
+ugc_record_stop(ugc_t* gc);
+
+/**
+ * @brief Start decoding a recording.
+ *
+ * @return 0 on success, -1 if `data` is not a recording.
+ */
+UGC_DECL int
+ugc_record_reader_init(ugc_record_reader_t* reader, const void* data, size_t size);
+
+/**
+ * @brief Decode the next operation.
+ *
+ * @return 1 if an operation was decoded, 0 at the end of the recording and -1
+ * if the recording is corrupted.
+ */
+UGC_DECL int
+ugc_record_read(ugc_record_reader_t* reader, ugc_record_op_t* op);
+
+#endif
+
+#if UGC_USE_PROFILE
+
+/// Prepare an empty profile.
+UGC_DECL void
+ugc_profile_init(
+	ugc_profile_t* profile,
+	ugc_profile_node_t* nodes, size_t max_nodes,
+	size_t* edges, size_t max_edges
+);
+
+/**
+ * @brief Take a snapshot of the objects reachable from the root.
+ *
+ * The object graph is traversed with the scan callback, independently from
+ * the collector which is left untouched. It can be called in any state.
+ * Retained sizes are computed from the dominator tree of the graph.
+ *
+ * @remarks It MUST NOT be called from a callback. Under UGC_USE_THREADS, it
+ * MUST be called between ugc_safepoint_begin and ugc_safepoint_end.
+ * @return 0 on success, -1 if the profile is too small to hold the graph.
+ * In which case, the profile is incomplete and sizes are not computed.
+ */
+UGC_DECL int
+ugc_profile_take(ugc_t* gc, ugc_profile_t* profile, ugc_describe_fn_t describe_fn);
+
+/**
+ * @brief Aggregate a profile by type.
+ *
+ * @param types Array indexed by type tag. Nodes with a type greater or equal
+ * to `num_types` are ignored.
+ */
+UGC_DECL void
+ugc_profile_aggregate(
+	const ugc_profile_t* profile,
+	ugc_profile_type_t* types, size_t num_types
+);
+
+/**
+ * @brief Write a profile in the V8 heap snapshot format.
+ *
+ * The output can be loaded in the memory panel of Chrome DevTools.
+ *
+ * @param type_names Name of each type tag, used as node names.
+ */
+UGC_DECL void
+ugc_profile_write(
+	const ugc_profile_t* profile,
+	const char* const* type_names, size_t num_types,
+	ugc_write_fn_t write_fn, void* ctx
+);
+
+#endif
+
+#if UGC_USE_THREADS
+
+/**
+ * @brief Attach the calling thread to a GC.
+ *
+ * Once attached, a thread may call ugc_register and ugc_write_barrier
+ * concurrently with other attached threads. It MUST call ugc_safepoint
+ * regularly (e.g: on function calls and loop back-edges) or surround blocking
+ * operations with ugc_thread_block and ugc_thread_unblock.
+ *
+ * If `scan_fn` is not NULL, it will be called during every root scan, after
+ * the GC's scan callback, and must call ugc_visit on all roots owned by this
+ * thread (e.g: its stack).
+ *
+ * @remarks `thread` MUST stay valid until ugc_thread_detach is called.
+ */
+UGC_DECL void
+ugc_thread_attach(ugc_t* gc, ugc_thread_t* thread, ugc_thread_scan_fn_t scan_fn);
+
+/// Detach the calling thread from a GC.
+UGC_DECL void
+ugc_thread_detach(ugc_t* gc, ugc_thread_t* thread);
+
+/**
+ * @brief Register a new object from an attached thread without locking.
+ *
+ * The object is kept in a list owned by `thread` and is handed over to the GC
+ * at the start of the next ugc_step.
+ *
+ * @remarks This MUST ONLY be called by the thread which owns `thread`.
+ * @see ugc_register
+ */
+UGC_DECL void
+ugc_register_local(ugc_t* gc, ugc_thread_t* thread, ugc_header_t* obj);
+
+/**
+ * @brief Poll for a pending safepoint.
+ *
+ * If another thread is waiting to collect, the calling thread will stop here
+ * until ugc_safepoint_end is called.
+ */
+UGC_DECL void
+ugc_safepoint(ugc_t* gc, ugc_thread_t* thread);
+
+#if UGC_USE_CONSERVATIVE
+
+/**
+ * @brief Scan the stack and registers of an attached thread conservatively.
+ *
+ * A thread stopped in ugc_safepoint has spilled its registers to its stack.
+ * The callee-saved registers of a blocked thread are saved by
+ * ugc_thread_block. On x86-64 and AArch64, this is done in assembly. On other
+ * targets, setjmp is used and registers it mangles (e.g: the frame pointer
+ * with glibc) are missed, so references MUST NOT only be held in them across
+ * a blocking call.
+ *
+ * The calling thread is scanned with ugc_scan_stack.
+ *
+ * @remarks This MUST ONLY be called inside the scan callback of a thread.
+ * @see ugc_thread_t::stack_base
+ */
+UGC_DECL void
+ugc_scan_thread(ugc_t* gc, ugc_thread_t* thread);
+
+#endif
+
+/**
+ * @brief Mark the calling thread as being outside of managed code.
+ *
+ * A blocked thread counts as having reached a safepoint so it does not delay
+ * a collection. It MUST NOT touch the GC or any managed object until
+ * ugc_thread_unblock is called.
+ */
+UGC_DECL void
+ugc_thread_block(ugc_t* gc, ugc_thread_t* thread);
+
+/**
+ * @brief Reenter managed code.
+ *
+ * This will wait if a safepoint is in progress.
+ */
+UGC_DECL void
+ugc_thread_unblock(ugc_t* gc, ugc_thread_t* thread);
+
+/**
+ * @brief Bring all attached threads to a safepoint.
+ *
+ * This returns once all other attached threads are stopped at ugc_safepoint
+ * or blocked. ugc_step and ugc_collect MUST ONLY be called between
+ * ugc_safepoint_begin and ugc_safepoint_end.
+ *
+ * `self` is the calling thread, it can be NULL if the calling thread is not
+ * attached. If several threads request a safepoint at the same time, they
+ * will be served one after another.
+ */
+UGC_DECL void
+ugc_safepoint_begin(ugc_t* gc, ugc_thread_t* self);
+
+/// Resume all threads stopped by ugc_safepoint_begin.
+UGC_DECL void
+ugc_safepoint_end(ugc_t* gc);
+
+/**
+ * @brief Make a handle refer to an object.
+ *
+ * As long as it is set, the handle is part of the root set of `gc`. This can
+ * be called from any thread, attached or not. It is typically used to refer
+ * to an object from another GC.
+ *
+ * @remarks `obj` MUST be managed by `gc` and MUST NOT be NULL.
+ * @remarks A handle can only be set in one GC at a time.
+ */
+UGC_DECL void
+ugc_handle_set(ugc_t* gc, ugc_handle_t* handle, ugc_header_t* obj);
+
+/// Remove a handle from the root set of `gc`.
+UGC_DECL void
+ugc_handle_clear(ugc_t* gc, ugc_handle_t* handle);
+
+/**
+ * @brief Initialize a group of GCs.
+ *
+ * `heaps` MUST stay valid as long as the group is in use. The array can be
+ * modified between rounds.
+ *
+ * Each GC in a group is stepped through ugc_safepoint_begin so all of its
+ * mutator threads MUST be attached.
+ */
+UGC_DECL void
+ugc_group_init(ugc_group_t* group, ugc_t** heaps, size_t num_heaps);
+
+/**
+ * @brief Start a new round of collection.
+ *
+ * @remarks This MUST NOT be called while ugc_group_step or ugc_group_collect
+ * is running.
+ */
+UGC_DECL void
+ugc_group_reset(ugc_group_t* group, size_t num_heaps);
+
+/**
+ * @brief Perform collection work for the current round.
+ *
+ * Each GC in the group is claimed by exactly one calling thread which will
+ * call ugc_step on it ugc_t::budget times. Any number of threads (e.g: a
+ * thread pool) can call this concurrently.
+ *
+ * @param self The calling thread if it is attached to a GC, NULL otherwise.
+ * It is blocked until the call returns so that its GC can be collected.
+ * @return Number of GCs stepped by the calling thread.
+ */
+UGC_DECL size_t
+ugc_group_step(ugc_group_t* group, ugc_thread_t* self);
+
+/**
+ * @brief Same as ugc_group_step but call ugc_collect instead.
+ *
+ * ugc_t::budget is ignored.
+ */
+UGC_DECL size_t
+ugc_group_collect(ugc_group_t* group, ugc_thread_t* self);
+
+#if UGC_USE_EPOCHS
+
+/**
+ * @brief Register a thread which reads managed objects without stopping at
+ * safepoints, e.g: lookups in a shared table.
+ *
+ * While readers are attached, garbage is only released once every reader
+ * which could have seen it has left its read section. This can be called
+ * from any thread.
+ */
+UGC_DECL void
+ugc_reader_attach(ugc_t* gc, ugc_reader_t* reader);
+
+/// Unregister a reader. It MUST NOT be in a read section.
+UGC_DECL void
+ugc_reader_detach(ugc_t* gc, ugc_reader_t* reader);
+
+/**
+ * @brief Enter a read section.
+ *
+ * Objects reachable at this point are not released before ugc_read_end is
+ * called, even if they become garbage in the meantime.
+ *
+ * @remarks References MUST NOT be kept after ugc_read_end unless they are
+ * visible to the GC (e.g: stored in a root).
+ * @remarks Read sections cannot be nested.
+ */
+UGC_DECL void
+ugc_read_begin(ugc_t* gc, ugc_reader_t* reader);
+
+/// Leave a read section. This is a quiescent point for the reader.
+UGC_DECL void
+ugc_read_end(ugc_reader_t* reader);
+
+/**
+ * @brief Release garbage which can no longer be read.
+ *
+ * This is done at the start and at the end of each cycle. It can be called
+ * more often to reduce the amount of pending garbage.
+ *
+ * @remarks This MUST be called under the same conditions as ugc_step.
+ */
+UGC_DECL void
+ugc_reclaim(ugc_t* gc);
+
+#endif
+
+#endif
+
+#ifdef UGC_IMPLEMENTATION
+
+#define UGC_GRAY 2
+// Objects of the open region, which are implicitly black
+#define UGC_REGION 3
+
+#if UGC_USE_TAGGED_POINTER
+
+#define UGC_PTR(ptr) ((uintptr_t)ptr & (~0x03))
+#define UGC_TAG(ptr) ((uintptr_t)ptr & 0x03)
+#define UGC_SET_PTR(ptr, val) \
+	do { ptr = (ugc_header_t*)((uintptr_t)val | UGC_TAG(ptr)); } while(0)
+#define UGC_SET_TAG(ptr, val) \
+	do { ptr = (ugc_header_t*)(UGC_PTR(ptr) | (uintptr_t)val); } while(0)
+
+static inline void
+ugc_set_next(ugc_header_t* obj, ugc_header_t* value)
+{
+	UGC_SET_PTR(obj->next, value);
+}
+
+static inline ugc_header_t*
+ugc_next(ugc_header_t* obj)
+{
+	return (ugc_header_t*)UGC_PTR(obj->next);
+}
+
+static inline void
+ugc_set_prev(ugc_header_t* obj, ugc_header_t* value)
+{
+	UGC_SET_PTR(obj->prev, value);
+}
+
+static inline ugc_header_t*
+ugc_prev(ugc_header_t* obj)
+{
+	return (ugc_header_t*)UGC_PTR(obj->prev);
+}
+
+static inline void
+ugc_set_color(ugc_header_t* obj, unsigned char color)
+{
+	UGC_SET_TAG(obj->next, color);
+}
+
+static inline unsigned char
+ugc_color(ugc_header_t* obj)
+{
+	return (unsigned char)UGC_TAG(obj->next);
+}
+
+#else
+
+static inline void
+ugc_set_next(ugc_header_t* obj, ugc_header_t* value)
+{
+	obj->next = value;
+}
+
+static inline ugc_header_t*
+ugc_next(ugc_header_t* obj)
+{
+	return obj->next;
+}
+
+static inline void
+ugc_set_prev(ugc_header_t* obj, ugc_header_t* value)
+{
+	obj->prev = value;
+}
+
+static inline ugc_header_t*
+ugc_prev(ugc_header_t* obj)
+{
+	return obj->prev;
+}
+
+static inline void
+ugc_set_color(ugc_header_t* obj, unsigned char color)
+{
+	obj->color = color;
+}
+
+static unsigned char
+ugc_color(ugc_header_t* obj)
+{
+	return obj->color;
+}
+
+#endif
+
+static void
+ugc_push(ugc_header_t* list, ugc_header_t* element)
+{
+	ugc_set_next(element, list);
+	ugc_set_prev(element, list->prev);
+	ugc_set_next(list->prev, element);
+	ugc_set_prev(list, element);
+}
+
+static void
+ugc_unlink(ugc_header_t* element)
+{
+	ugc_header_t* next = ugc_next(element);
+	ugc_header_t* prev = ugc_prev(element);
+
+	ugc_set_prev(next, prev);
+	ugc_set_next(prev, next);
+}
+
+static void
+ugc_make_gray(ugc_t* gc, ugc_header_t* obj)
+{
+	// Move iterator back before moving obj
+	if(obj == gc->iterator) { gc->iterator = ugc_prev(obj); }
+
+	ugc_unlink(obj);
+	ugc_push(gc->to, obj);
+	ugc_set_color(obj, UGC_GRAY);
+}
+
+static void
+ugc_clear(ugc_header_t* list)
+{
+	list->next = list;
+	list->prev = list;
+}
+
+static void
+ugc_splice(ugc_header_t* list, ugc_header_t* chain)
+{
+	ugc_header_t* first = ugc_next(chain);
+	if(first == chain) { return; }
+
+	ugc_header_t* last = ugc_prev(chain);
+	ugc_header_t* tail = ugc_prev(list);
+
+	ugc_set_next(tail, first);
+	ugc_set_prev(first, tail);
+	ugc_set_next(last, list);
+	ugc_set_prev(list, last);
+	ugc_clear(chain);
+}
+
+#if UGC_USE_THREADS
+
+#ifndef UGC_YIELD
+#include <sched.h>
+#define UGC_YIELD() sched_yield()
+#endif
+
+enum ugc_thread_state_e
+{
+	UGC_THREAD_RUNNING,
+	UGC_THREAD_PARKED
+};
+
+static void
+ugc_lock(atomic_flag* lock)
+{
+	while(atomic_flag_test_and_set_explicit(lock, memory_order_acquire))
+	{
+		UGC_YIELD();
+	}
+}
+
+static void
+ugc_unlock(atomic_flag* lock)
+{
+	atomic_flag_clear_explicit(lock, memory_order_release);
+}
+
+static void
+ugc_thread_wait(ugc_t* gc, ugc_thread_t* thread)
+{
+	for(;;)
+	{
+		while(atomic_load(&gc->safepoint)) { UGC_YIELD(); }
+
+		// A new safepoint may have been requested after the check above but
+		// before the requesting thread saw this thread running again.
+		atomic_store(&thread->state, UGC_THREAD_RUNNING);
+		if(!atomic_load(&gc->safepoint)) { break; }
+		atomic_store(&thread->state, UGC_THREAD_PARKED);
+	}
+}
+
+#endif
+
+#if UGC_USE_STATS || UGC_USE_TRACE || UGC_USE_PACER
+
+#ifndef UGC_CLOCK
+#include <time.h>
+
+static inline uint64_t
+ugc_clock(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+#define UGC_CLOCK() ugc_clock()
+#endif
+
+#endif
+
+#if UGC_USE_STATS
+
+static inline unsigned int
+ugc_log2(uint64_t value)
+{
+#if defined(__GNUC__)
+	return 63 - __builtin_clzll(value);
+#else
+	unsigned int result = 0;
+	while(value >>= 1) { ++result; }
+	return result;
+#endif
+}
+
+static unsigned int
+ugc_histogram_index(uint64_t value)
+{
+	if(value < (1 << UGC_HISTOGRAM_SUB_BITS)) { return (unsigned int)value; }
+
+	unsigned int group = ugc_log2(value) - UGC_HISTOGRAM_SUB_BITS + 1;
+	if(group > UGC_HISTOGRAM_MAX_BITS - UGC_HISTOGRAM_SUB_BITS)
+	{
+		return UGC_HISTOGRAM_NUM_BUCKETS - 1;
+	}
+
+	unsigned int sub = (value >> (group - 1)) & ((1 << UGC_HISTOGRAM_SUB_BITS) - 1);
+	return (group << UGC_HISTOGRAM_SUB_BITS) | sub;
+}
+
+static uint64_t
+ugc_histogram_value(unsigned int index)
+{
+	if(index < (1 << UGC_HISTOGRAM_SUB_BITS)) { return index; }
+
+	unsigned int group = index >> UGC_HISTOGRAM_SUB_BITS;
+	unsigned int sub = index & ((1 << UGC_HISTOGRAM_SUB_BITS) - 1);
+	return (uint64_t)((1 << UGC_HISTOGRAM_SUB_BITS) | sub) << (group - 1);
+}
+
+static void
+ugc_histogram_record(ugc_histogram_t* histogram, uint64_t value)
+{
+	++histogram->count;
+	histogram->total += value;
+	if(value > histogram->max) { histogram->max = value; }
+	++histogram->buckets[ugc_histogram_index(value)];
+}
+
+static void
+ugc_stats_begin_cycle(ugc_t* gc, uint64_t now)
+{
+	gc->stats.cycle_start = now;
+	gc->stats.cycle_work = 0;
+}
+
+static void
+ugc_stats_end_cycle(ugc_t* gc, uint64_t now)
+{
+	ugc_stats_t* stats = &gc->stats;
+	++stats->num_cycles;
+	stats->last_cycle_work = stats->cycle_work;
+	stats->last_cycle_duration = now - stats->cycle_start;
+	stats->total_cycle_work += stats->last_cycle_work;
+	stats->total_cycle_duration += stats->last_cycle_duration;
+}
+
+#endif
+
+#if UGC_USE_PERF
+
+#include <linux/perf_event.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static void
+ugc_perf_read(ugc_t* gc, uint64_t* values)
+{
+	// Counters are opened as a single group so they can be read at once
+	struct
+	{
+		uint64_t nr;
+		uint64_t values[UGC_COUNTER_COUNT];
+	} data;
+
+	memset(values, 0, sizeof(uint64_t) * UGC_COUNTER_COUNT);
+
+	int group = gc->perf_fds[0];
+	for(int i = 1; group < 0 && i < UGC_COUNTER_COUNT; ++i)
+	{
+		group = gc->perf_fds[i];
+	}
+
+	if(group < 0 || read(group, &data, sizeof(data)) < (ssize_t)sizeof(data.nr))
+	{
+		return;
+	}
+
+	uint64_t n = 0;
+	for(int i = 0; i < UGC_COUNTER_COUNT && n < data.nr; ++i)
+	{
+		if(gc->perf_fds[i] >= 0) { values[i] = data.values[n++]; }
+	}
+}
+
+#endif
+
+#if UGC_USE_RECORD
+
+#include <string.h>
+
+#define UGC_RECORD_MAGIC "UGCR\x01"
+// A type and two varints
+#define UGC_RECORD_MAX_SIZE (1 + 2 * 10)
+
+static void
+ugc_record_obj(ugc_t* gc, ugc_header_t* obj)
+{
+	uintptr_t id = (uintptr_t)obj / _Alignof(ugc_header_t);
+	intptr_t delta = (intptr_t)(id - gc->record_last);
+	gc->record_last = id;
+
+	// Zigzag encoding keeps small negative deltas short
+	uint64_t value = delta < 0
+		? ((uint64_t)~delta << 1) | 1
+		: (uint64_t)delta << 1;
+
+	unsigned char* buf = gc->record_buf;
+	size_t size = gc->record_size;
+	while(value >= 0x80)
+	{
+		buf[size++] = (unsigned char)(value | 0x80);
+		value >>= 7;
+	}
+	buf[size++] = (unsigned char)value;
+	gc->record_size = size;
+}
+
+static void
+ugc_record(
+	ugc_t* gc,
+	enum ugc_record_type_e type,
+	ugc_header_t* obj,
+	ugc_header_t* child
+)
+{
+	if(gc->record_fn == NULL) { return; }
+
+	if(gc->record_size + UGC_RECORD_MAX_SIZE > UGC_RECORD_BUFFER_SIZE)
+	{
+		ugc_record_flush(gc);
+	}
+
+	gc->record_buf[gc->record_size++] = (unsigned char)type;
+	if(obj != NULL) { ugc_record_obj(gc, obj); }
+	if(child != NULL) { ugc_record_obj(gc, child); }
+}
+
+#endif
+
+#if UGC_USE_PROFILE
+
+#include <stdio.h>
+
+// While profiling, the "prev" link of visited objects holds their node index.
+// It is always even otherwise.
+static void
+ugc_profile_visit(ugc_profile_t* profile, ugc_header_t* obj)
+{
+	uintptr_t prev = (uintptr_t)obj->prev;
+	size_t index;
+
+	if(prev & 1)
+	{
+		index = prev >> 1;
+	}
+	else
+	{
+		if(profile->num_nodes == profile->max_nodes)
+		{
+			profile->overflow = 1;
+			return;
+		}
+
+		index = profile->num_nodes++;
+		ugc_profile_node_t* node = &profile->nodes[index];
+		node->obj = obj;
+		node->prev = obj->prev;
+		node->num_edges = 0;
+		// The node which discovered this one is a first approximation
+		node->dominator = profile->current;
+		obj->prev = (ugc_header_t*)(((uintptr_t)index << 1) | 1);
+	}
+
+	if(profile->num_edges == profile->max_edges)
+	{
+		profile->overflow = 1;
+		return;
+	}
+
+	profile->edges[profile->num_edges++] = index;
+	++profile->nodes[profile->current].num_edges;
+}
+
+static size_t
+ugc_profile_intersect(ugc_profile_node_t* nodes, size_t a, size_t b)
+{
+	// Breadth-first order guarantees that dominators come first
+	while(a != b)
+	{
+		while(a > b) { a = nodes[a].dominator; }
+		while(b > a) { b = nodes[b].dominator; }
+	}
+
+	return a;
+}
+
+// "A Simple, Fast Dominance Algorithm", Cooper, Harvey and Kennedy
+static void
+ugc_profile_dominators(ugc_profile_t* profile)
+{
+	ugc_profile_node_t* nodes = profile->nodes;
+	int changed = 1;
+
+	while(changed)
+	{
+		changed = 0;
+		for(size_t i = 0; i < profile->num_nodes; ++i)
+		{
+			ugc_profile_node_t* node = &nodes[i];
+			for(size_t j = 0; j < node->num_edges; ++j)
+			{
+				size_t child = profile->edges[node->first_edge + j];
+				if(child == 0) { continue; }
+
+				size_t dominator = ugc_profile_intersect(nodes, i, nodes[child].dominator);
+				if(dominator != nodes[child].dominator)
+				{
+					nodes[child].dominator = dominator;
+					changed = 1;
+				}
+			}
+		}
+	}
+}
+
+#endif
+
+#if UGC_USE_TRACE
+
+#include <stdio.h>
+
+static void
+ugc_trace_emit(
+	ugc_t* gc,
+	enum ugc_trace_type_e type,
+	char phase,
+	uint64_t timestamp,
+	uint64_t duration
+)
+{
+	if(gc->trace_events == NULL) { return; }
+
+	size_t index = atomic_fetch_add_explicit(&gc->trace_head, 1, memory_order_relaxed);
+	ugc_trace_event_t* event = &gc->trace_events[index & gc->trace_mask];
+
+	// A zero sequence number tells ugc_trace_dump to skip this event
+	atomic_store_explicit(&event->sequence, 0, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	event->timestamp = timestamp;
+	event->duration = duration;
+	event->type = type;
+	event->phase = phase;
+	atomic_store_explicit(&event->sequence, index + 1, memory_order_release);
+}
+
+static void
+ugc_trace_step(ugc_t* gc, enum ugc_phase_e phase, uint64_t start, uint64_t end)
+{
+	if(gc->trace_events == NULL) { return; }
+
+	switch(phase)
+	{
+		case UGC_PHASE_ROOT:
+			ugc_trace_emit(gc, UGC_TRACE_CYCLE, 'B', start, 0);
+			ugc_trace_emit(gc, UGC_TRACE_ROOT_SCAN, 'X', start, end - start);
+			ugc_trace_emit(gc, UGC_TRACE_MARK, 'B', end, 0);
+			break;
+		case UGC_PHASE_MARK:
+			if(end - start >= gc->trace_threshold)
+			{
+				ugc_trace_emit(gc, UGC_TRACE_LARGE_SCAN, 'X', start, end - start);
+			}
+			break;
+		case UGC_PHASE_TERMINATION:
+			ugc_trace_emit(gc, UGC_TRACE_TERMINATION, 'X', start, end - start);
+			if(gc->state == UGC_SWEEP)
+			{
+				ugc_trace_emit(gc, UGC_TRACE_MARK, 'E', end, 0);
+				ugc_trace_emit(gc, UGC_TRACE_SWEEP, 'B', end, 0);
+			}
+			break;
+		case UGC_PHASE_SWEEP:
+			if(gc->state == UGC_IDLE)
+			{
+				ugc_trace_emit(gc, UGC_TRACE_SWEEP, 'E', end, 0);
+				ugc_trace_emit(gc, UGC_TRACE_CYCLE, 'E', end, 0);
+			}
+			break;
+		case UGC_PHASE_COUNT:
+			break;
+	}
+}
+
+#endif
+
+// Pinned objects are encoded as is while free slots hold the next free slot
+// plus one, shifted left and tagged with 1
+#define UGC_PIN_IS_FREE(value) (((value) & 1) != 0)
+
+static inline int
+ugc_pins_pending(ugc_t* gc)
+{
+#if UGC_USE_PINS
+	return gc->pin_cursor < gc->pin_size;
+#else
+	(void)gc;
+	return 0;
+#endif
+}
+
+static void
+ugc_scan_pins(ugc_t* gc, size_t max_slots)
+{
+#if UGC_USE_PINS
+#if UGC_USE_THREADS
+	ugc_lock(&gc->heap_lock);
+#endif
+
+	size_t end = gc->pin_size - gc->pin_cursor > max_slots
+		? gc->pin_cursor + max_slots
+		: gc->pin_size;
+
+#if UGC_USE_RECORD
+	// Pins are roots, even when they are scanned between two objects
+	if(end > gc->pin_cursor) { ugc_record(gc, UGC_RECORD_RESCAN_ROOTS, NULL, NULL); }
+#endif
+	for(size_t i = gc->pin_cursor; i < end; ++i)
+	{
+		uintptr_t value = gc->pin_slots[i];
+		if(!UGC_PIN_IS_FREE(value)) { ugc_visit(gc, (ugc_header_t*)value); }
+	}
+	gc->pin_cursor = end;
+
+#if UGC_USE_THREADS
+	ugc_unlock(&gc->heap_lock);
+#endif
+#else
+	(void)gc;
+	(void)max_slots;
+#endif
+}
+
+static inline enum ugc_phase_e
+ugc_phase(ugc_t* gc)
+{
+	switch((enum ugc_state_e)gc->state)
+	{
+		case UGC_IDLE:
+			return UGC_PHASE_ROOT;
+		case UGC_MARK:
+			return ugc_next(gc->iterator) != gc->to || ugc_pins_pending(gc)
+				? UGC_PHASE_MARK
+				: UGC_PHASE_TERMINATION;
+		case UGC_SWEEP:
+		default:
+			return UGC_PHASE_SWEEP;
+	}
+}
+
+// How a root scan treats fibers and pins
+enum ugc_root_scan_e
+{
+	/// Scan everything without tracking progress (e.g: for the heap profiler).
+	UGC_ROOTS_ALL,
+	/// Scan all fibers and start scanning pins at the start of a mark phase.
+	UGC_ROOTS_INITIAL,
+	/// Only scan fibers which ran since they were last scanned.
+	UGC_ROOTS_RESCAN
+};
+
+#if UGC_USE_FIBERS
+
+enum ugc_fiber_state_e
+{
+	UGC_FIBER_CLEAN,
+	UGC_FIBER_DIRTY,
+	UGC_FIBER_RUNNING
+};
+
+static void
+ugc_fiber_unlink(ugc_fiber_t* fiber)
+{
+	fiber->prev->next = fiber->next;
+	fiber->next->prev = fiber->prev;
+}
+
+static void
+ugc_fiber_push(ugc_fiber_t* list, ugc_fiber_t* fiber)
+{
+	fiber->next = list;
+	fiber->prev = list->prev;
+	list->prev->next = fiber;
+	list->prev = fiber;
+}
+
+static void
+ugc_visit_fibers(ugc_t* gc, enum ugc_root_scan_e mode)
+{
+	ugc_fiber_t* dirty = &gc->dirty_fibers;
+	ugc_fiber_t* clean = &gc->clean_fibers;
+
+	if(mode == UGC_ROOTS_ALL)
+	{
+		for(ugc_fiber_t* itr = dirty->next; itr != dirty; itr = itr->next) { itr->scan_fn(gc, itr); }
+		for(ugc_fiber_t* itr = clean->next; itr != clean; itr = itr->next) { itr->scan_fn(gc, itr); }
+		return;
+	}
+
+	// Colors were reset since the last scan, everything is dirty again
+	if(mode == UGC_ROOTS_INITIAL && clean->next != clean)
+	{
+		clean->next->prev = dirty->prev;
+		dirty->prev->next = clean->next;
+		clean->prev->next = dirty;
+		dirty->prev = clean->prev;
+		clean->next = clean;
+		clean->prev = clean;
+	}
+
+	// A suspended fiber cannot modify its roots. Those were visited so they
+	// stay gray or black until the end of the cycle.
+	for(ugc_fiber_t* itr = dirty->next; itr != dirty;)
+	{
+		ugc_fiber_t* next = itr->next;
+
+		itr->scan_fn(gc, itr);
+		if(itr->state != UGC_FIBER_RUNNING)
+		{
+			itr->state = UGC_FIBER_CLEAN;
+			ugc_fiber_unlink(itr);
+			ugc_fiber_push(clean, itr);
+		}
+
+		itr = next;
+	}
+}
+
+#endif
+
+static void
+ugc_visit_roots(ugc_t* gc, enum ugc_root_scan_e mode)
+{
+	gc->scan_fn(gc, NULL);
+
+#if UGC_USE_FIBERS
+	ugc_visit_fibers(gc, mode);
+#endif
+
+#if UGC_USE_PINS
+	if(mode == UGC_ROOTS_ALL)
+	{
+		for(size_t i = 0; i < gc->pin_size; ++i)
+		{
+			uintptr_t value = gc->pin_slots[i];
+			if(!UGC_PIN_IS_FREE(value)) { ugc_visit(gc, (ugc_header_t*)value); }
+		}
+	}
+	else if(mode == UGC_ROOTS_INITIAL)
+	{
+		// Objects pinned after this point are grayed by ugc_pin, the table is
+		// only scanned once per cycle
+		gc->pin_cursor = 0;
+		ugc_scan_pins(gc, UGC_PIN_SCAN_CHUNK);
+	}
+#endif
+
+#if UGC_USE_FINALIZERS
+	// Objects are only queued while marking and they are grayed then
+	if(mode != UGC_ROOTS_RESCAN)
+	{
+#if UGC_USE_THREADS
+		ugc_lock(&gc->heap_lock);
+#endif
+		ugc_finalizable_t* queue = &gc->finalize_queue;
+		for(ugc_finalizable_t* itr = queue->next; itr != queue; itr = itr->next)
+		{
+			ugc_visit(gc, &itr->header);
+		}
+#if UGC_USE_THREADS
+		ugc_unlock(&gc->heap_lock);
+#endif
+	}
+#endif
+
+	(void)mode;
+
+#if UGC_USE_THREADS
+	for(ugc_thread_t* itr = gc->threads; itr != NULL; itr = itr->next)
+	{
+		if(itr->scan_fn != NULL) { itr->scan_fn(gc, itr); }
+	}
+
+	// Handles can be set by threads which are not stopped by the safepoint
+	ugc_lock(&gc->heap_lock);
+	for(ugc_handle_t* itr = gc->handles.next; itr != &gc->handles; itr = itr->next)
+	{
+		ugc_visit(gc, itr->target);
+	}
+	ugc_unlock(&gc->heap_lock);
+#endif
+}
+
+#if UGC_USE_LAYOUT
+
+#include <string.h>
+
+#ifndef UGC_PREFETCH
+#if defined(__GNUC__) || defined(__clang__)
+#define UGC_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define UGC_PREFETCH(addr) (void)(addr)
+#endif
+#endif
+
+#ifndef UGC_PREFETCH_DISTANCE
+#define UGC_PREFETCH_DISTANCE 8
+#endif
+
+static inline ugc_header_t*
+ugc_load_ptr(const char* addr)
+{
+	// Fields hold pointers to types which start with a header
+	ugc_header_t* ptr;
+	memcpy(&ptr, addr, sizeof(ptr));
+	return ptr;
+}
+
+static inline void
+ugc_visit_field(ugc_t* gc, ugc_header_t* child, unsigned char white, int observed)
+{
+	if(child == NULL) { return; }
+
+	if(observed)
+	{
+		ugc_visit(gc, child);
+	}
+	else if(ugc_color(child) == white)
+	{
+		ugc_make_gray(gc, child);
+	}
+}
+
+static void
+ugc_scan_layout(ugc_t* gc, ugc_header_t* obj, const ugc_layout_t* layout)
+{
+	const char* base = (const char*)obj;
+	unsigned char white = gc->white;
+	int observed = 0;
+#if UGC_USE_PROFILE
+	observed |= gc->profile != NULL;
+#endif
+#if UGC_USE_RECORD
+	observed |= gc->record_fn != NULL;
+#endif
+
+	// Fetch all children before testing their colors
+	const size_t* fields = layout->fields;
+	size_t num_fields = layout->num_fields;
+	for(size_t i = 0; i < num_fields; ++i)
+	{
+		UGC_PREFETCH(ugc_load_ptr(base + fields[i]));
+	}
+
+	for(size_t i = 0; i < num_fields; ++i)
+	{
+		ugc_visit_field(gc, ugc_load_ptr(base + fields[i]), white, observed);
+	}
+
+	for(size_t i = 0; i < layout->num_ranges; ++i)
+	{
+		const ugc_layout_range_t* range = &layout->ranges[i];
+
+		size_t length;
+		memcpy(&length, base + range->length_offset, sizeof(length));
+
+		const char* slots = range->indirect
+			? (const char*)ugc_load_ptr(base + range->offset)
+			: base + range->offset;
+		if(slots == NULL) { continue; }
+
+		for(size_t j = 0; j < length; ++j)
+		{
+			if(j + UGC_PREFETCH_DISTANCE < length)
+			{
+				UGC_PREFETCH(ugc_load_ptr(slots + (j + UGC_PREFETCH_DISTANCE) * sizeof(ugc_header_t*)));
+			}
+
+			ugc_visit_field(gc, ugc_load_ptr(slots + j * sizeof(ugc_header_t*)), white, observed);
+		}
+	}
+}
+
+#endif
+
+static inline void
+ugc_scan(ugc_t* gc, ugc_header_t* obj)
+{
+#if UGC_USE_LAYOUT
+	if(gc->layout_offset != 0)
+	{
+		const ugc_layout_t* layout;
+		memcpy(&layout, (const char*)obj + gc->layout_offset, sizeof(layout));
+		if(layout != NULL)
+		{
+			ugc_scan_layout(gc, obj, layout);
+			return;
+		}
+	}
+#endif
+
+	gc->scan_fn(gc, obj);
+}
+
+static void
+ugc_scan_roots(ugc_t* gc, enum ugc_root_scan_e mode)
+{
+#if UGC_USE_RECORD
+	// A rescan may only visit part of the root set (e.g: dirty fibers)
+	ugc_record(
+		gc,
+		mode == UGC_ROOTS_RESCAN ? UGC_RECORD_RESCAN_ROOTS : UGC_RECORD_SCAN_ROOTS,
+		NULL,
+		NULL
+	);
+#endif
+
+	ugc_visit_roots(gc, mode);
+
+#if UGC_USE_REGIONS
+	// Objects registered in the region after this scan are scanned right away
+	// and stores into them are caught by the write barrier
+	if(gc->region != NULL && mode == UGC_ROOTS_INITIAL)
+	{
+		ugc_header_t* list = &gc->region->objects;
+		for(ugc_header_t* itr = ugc_next(list); itr != list; itr = ugc_next(itr))
+		{
+			ugc_scan(gc, itr);
+		}
+	}
+#endif
+}
+
+static void
+ugc_adopt(ugc_t* gc, ugc_header_t* chain, unsigned char color)
+{
+	if(color == gc->white)
+	{
+		ugc_splice(gc->from, chain);
+	}
+	else if(gc->state != UGC_SWEEP)
+	{
+		// Everything after the iterator in "to" will be scanned before the end
+		// of the mark phase regardless of its color.
+		ugc_splice(gc->to, chain);
+	}
+	else
+	{
+		for(ugc_header_t* itr = ugc_next(chain); itr != chain; itr = ugc_next(itr))
+		{
+			ugc_set_color(itr, gc->white);
+		}
+
+		ugc_splice(gc->from, chain);
+	}
+}
+
+#if UGC_USE_THREADS
+
+static void
+ugc_flush_local(ugc_t* gc, ugc_thread_t* thread)
+{
+	// Local objects are colored according to the state at registration time
+	// and the state cannot change without a flush.
+	ugc_splice(gc->state == UGC_MARK ? gc->to : gc->from, &thread->local);
+}
+
+#endif
+
+static void
+ugc_flush_threads(ugc_t* gc)
+{
+#if UGC_USE_THREADS
+	for(ugc_thread_t* itr = gc->threads; itr != NULL; itr = itr->next)
+	{
+		ugc_flush_local(gc, itr);
+	}
+#else
+	(void)gc;
+#endif
+}
+
+#if UGC_USE_EPOCHS
+
+// Garbage found in epoch e is kept in limbo[e % 3]. Once the epoch reaches
+// e + 2, all readers which started before it was found have left.
+static void
+ugc_release_limbo(ugc_t* gc, unsigned int index)
+{
+	ugc_header_t* itr = gc->limbo[index];
+	gc->limbo[index] = NULL;
+
+	while(itr != NULL)
+	{
+		ugc_header_t* next = ugc_next(itr);
+		gc->release_fn(gc, itr);
+		itr = next;
+	}
+}
+
+// Only advance once all readers in a read section have seen the current
+// epoch
+static int
+ugc_advance_epoch(ugc_t* gc)
+{
+	if(gc->limbo[0] == NULL && gc->limbo[1] == NULL && gc->limbo[2] == NULL) { return 0; }
+
+	uintptr_t epoch = atomic_load(&gc->epoch);
+
+	ugc_lock(&gc->heap_lock);
+	for(ugc_reader_t* itr = gc->readers.next; itr != &gc->readers; itr = itr->next)
+	{
+		uintptr_t reader_epoch = atomic_load(&itr->epoch);
+		if(reader_epoch != 0 && reader_epoch != epoch)
+		{
+			ugc_unlock(&gc->heap_lock);
+			return 0;
+		}
+	}
+	ugc_unlock(&gc->heap_lock);
+
+	atomic_store(&gc->epoch, epoch + 1);
+	ugc_release_limbo(gc, (unsigned int)((epoch + 2) % 3));
+	return 1;
+}
+
+#endif
+
+static inline void
+ugc_release(ugc_t* gc, ugc_header_t* obj)
+{
+#if UGC_USE_CONSERVATIVE
+	if(gc->index != NULL) { ugc_index_remove(gc->index, obj); }
+#endif
+
+#if UGC_USE_EPOCHS
+	// Swept objects are no longer linked so their header can be reused
+	if(atomic_load(&gc->num_readers) != 0)
+	{
+		unsigned int index = (unsigned int)(atomic_load_explicit(&gc->epoch, memory_order_relaxed) % 3);
+		ugc_set_next(obj, gc->limbo[index]);
+		gc->limbo[index] = obj;
+		return;
+	}
+#endif
+
+	gc->release_fn(gc, obj);
+}
+
+#if UGC_USE_WEAK
+// Visited containers form a list ending with UGC_WEAK_END so that a NULL link
+// means not visited
+#define UGC_WEAK_END ((ugc_weak_t*)(uintptr_t)1)
+#endif
+
+// Gray the values of live keys, return whether any was found. Only a
+// termination with no such value ends the mark phase.
+static int
+ugc_mark_ephemerons(ugc_t* gc)
+{
+	int found = 0;
+
+#if UGC_USE_WEAK
+	unsigned char white = gc->white;
+	for(ugc_weak_t* itr = gc->weak_list; itr != UGC_WEAK_END; itr = itr->next)
+	{
+		ugc_header_t** refs = itr->refs;
+		ugc_header_t** values = itr->values;
+		if(values == NULL) { continue; }
+
+		for(size_t i = 0; i < itr->size; ++i)
+		{
+			ugc_header_t* value = values[i];
+			if(refs[i] != NULL && value != NULL
+				&& ugc_color(refs[i]) != white && ugc_color(value) == white)
+			{
+				ugc_visit(gc, value);
+				found = 1;
+			}
+		}
+	}
+#else
+	(void)gc;
+#endif
+
+	return found;
+}
+
+// Forget visited containers, clearing their references to white objects first
+// if the mark phase is complete
+static void
+ugc_finish_weak(ugc_t* gc, int clear)
+{
+#if UGC_USE_WEAK
+	unsigned char white = gc->white;
+	for(ugc_weak_t* itr = gc->weak_list; itr != UGC_WEAK_END;)
+	{
+		ugc_weak_t* next = itr->next;
+		ugc_header_t** refs = itr->refs;
+		ugc_header_t** values = itr->values;
+
+		for(size_t i = 0; clear && i < itr->size; ++i)
+		{
+			if(refs[i] != NULL && ugc_color(refs[i]) == white)
+			{
+				refs[i] = NULL;
+				if(values != NULL) { values[i] = NULL; }
+				++itr->num_cleared;
+			}
+		}
+
+		itr->next = NULL;
+		itr = next;
+	}
+
+	gc->weak_list = UGC_WEAK_END;
+#else
+	(void)gc;
+	(void)clear;
+#endif
+}
+
+// Move the objects picked by evacuate_fn then have every reference to them
+// updated, while all live objects are black and garbage is still white.
+// Weak containers were already cleared so they only refer to live objects.
+static void
+ugc_evacuate(ugc_t* gc)
+{
+#if UGC_USE_EVACUATION
+	gc->num_evacuated = 0;
+	if(gc->evacuate_fn == NULL) { return; }
+
+	ugc_header_t* to = gc->to;
+	for(ugc_header_t* itr = ugc_next(to); itr != to; itr = ugc_next(itr))
+	{
+		ugc_header_t* copy = gc->evacuate_fn(gc, itr);
+		if(copy == NULL || copy == itr) { continue; }
+
+		// The copy took the place of the original in "to", which is made gray
+		// to mark it as forwarded since no object is gray anymore
+		ugc_set_prev(ugc_next(copy), copy);
+		ugc_set_next(ugc_prev(copy), copy);
+		ugc_set_prev(itr, copy);
+		ugc_set_color(itr, UGC_GRAY);
+		++gc->num_evacuated;
+
+		itr = copy;
+	}
+
+	if(gc->num_evacuated == 0) { return; }
+
+	for(ugc_header_t* itr = ugc_next(to); itr != to; itr = ugc_next(itr))
+	{
+		gc->relocate_fn(gc, itr);
+	}
+
+#if UGC_USE_REGIONS
+	if(gc->region != NULL)
+	{
+		ugc_header_t* list = &gc->region->objects;
+		for(ugc_header_t* itr = ugc_next(list); itr != list; itr = ugc_next(itr))
+		{
+			gc->relocate_fn(gc, itr);
+		}
+	}
+#endif
+
+#if UGC_USE_PINS
+	for(size_t i = 0; i < gc->pin_size; ++i)
+	{
+		uintptr_t value = gc->pin_slots[i];
+		if(!UGC_PIN_IS_FREE(value))
+		{
+			gc->pin_slots[i] = (uintptr_t)ugc_forward(gc, (ugc_header_t*)value);
+		}
+	}
+#endif
+
+	gc->relocate_fn(gc, NULL);
+#else
+	(void)gc;
+#endif
+}
+
+// Queue and gray white finalizable objects, return whether any was found
+static int
+ugc_resurrect(ugc_t* gc)
+{
+	int found = 0;
+
+#if UGC_USE_FINALIZERS
+	unsigned char white = gc->white;
+	ugc_finalizable_t* list = &gc->finalizable;
+	ugc_finalizable_t* queue = &gc->finalize_queue;
+
+#if UGC_USE_THREADS
+	ugc_lock(&gc->heap_lock);
+#endif
+
+	for(ugc_finalizable_t* itr = list->next; itr != list;)
+	{
+		ugc_finalizable_t* next = itr->next;
+
+		if(ugc_color(&itr->header) == white)
+		{
+			itr->prev->next = next;
+			next->prev = itr->prev;
+			itr->next = queue;
+			itr->prev = queue->prev;
+			queue->prev->next = itr;
+			queue->prev = itr;
+			++gc->num_finalizers;
+
+			ugc_visit(gc, &itr->header);
+			found = 1;
+		}
+
+		itr = next;
+	}
+
+#if UGC_USE_THREADS
+	ugc_unlock(&gc->heap_lock);
+#endif
+#else
+	(void)gc;
+#endif
+
+	return found;
+}
+
+// Release white large objects without waiting for the sweep phase
+static void
+ugc_release_large(ugc_t* gc)
+{
+#if UGC_USE_LARGE
+	unsigned char white = gc->white;
+	ugc_large_t* list = &gc->large_objects;
+	for(ugc_large_t* itr = list->next; itr != list;)
+	{
+		ugc_large_t* next = itr->next;
+
+		if(ugc_color(&itr->header) == white)
+		{
+			itr->prev->next = next;
+			next->prev = itr->prev;
+			gc->large_size -= itr->size;
+			ugc_unlink(&itr->header);
+			ugc_release(gc, &itr->header);
+		}
+
+		itr = next;
+	}
+#else
+	(void)gc;
+#endif
+}
+
+static void
+ugc_finish_mark(ugc_t* gc)
+{
+	// Containers can move along with their owner, they are forgotten first
+	ugc_finish_weak(gc, 1);
+	ugc_evacuate(gc);
+	ugc_release_large(gc);
+
+	// Since we can get interrupted during the sweep phase, swap "from" and
+	// "to" set, flip white color before starting the sweep phase.
+	ugc_header_t* from = gc->from;
+	gc->from = gc->to;
+	gc->to = from;
+	gc->white = !gc->white;
+	gc->iterator = from->next;
+	gc->state = UGC_SWEEP;
+}
+
+#if UGC_USE_SORT
+enum ugc_sort_phase_e
+{
+	/// Move past the rest of the second run of the last pair.
+	UGC_SORT_SKIP,
+	/// Find the start of the second run of a pair.
+	UGC_SORT_SEEK,
+	/// Merge the two runs of a pair.
+	UGC_SORT_MERGE
+};
+#endif
+
+// Every sort_period cycles, take the survivors out of "from" so that they can
+// be sorted during the sweep phase while new objects are registered
+static void
+ugc_sort_begin(ugc_t* gc)
+{
+#if UGC_USE_SORT
+	if(gc->sort_period == 0 || ++gc->sort_cycles < gc->sort_period) { return; }
+
+	gc->sort_cycles = 0;
+
+#if UGC_USE_THREADS
+	ugc_lock(&gc->heap_lock);
+#endif
+
+	ugc_splice(&gc->sort_list, gc->from);
+
+#if UGC_USE_THREADS
+	ugc_unlock(&gc->heap_lock);
+#endif
+
+	gc->sort_b = ugc_next(&gc->sort_list);
+	gc->sort_nb = 0;
+	gc->sort_width = 1;
+	gc->sort_merged = 0;
+	gc->sort_phase = UGC_SORT_SKIP;
+#else
+	(void)gc;
+#endif
+}
+
+// Put the survivors back before the objects registered in the meantime,
+// sorted or not
+static void
+ugc_sort_end(ugc_t* gc)
+{
+#if UGC_USE_SORT
+	if(gc->sort_width == 0) { return; }
+
+#if UGC_USE_THREADS
+	ugc_lock(&gc->heap_lock);
+#endif
+
+	ugc_splice(&gc->sort_list, gc->from);
+	ugc_splice(gc->from, &gc->sort_list);
+
+#if UGC_USE_THREADS
+	ugc_unlock(&gc->heap_lock);
+#endif
+
+	gc->sort_width = 0;
+#else
+	(void)gc;
+#endif
+}
+
+// Run a bottom-up merge sort of the survivors for a bounded number of
+// operations, return whether it is still in progress
+static int
+ugc_sort(ugc_t* gc, size_t max_ops)
+{
+#if UGC_USE_SORT
+	if(gc->sort_width == 0) { return 0; }
+
+	ugc_header_t* list = &gc->sort_list;
+	ugc_header_t* a = gc->sort_a;
+	ugc_header_t* b = gc->sort_b;
+	size_t na = gc->sort_na;
+	size_t nb = gc->sort_nb;
+	size_t width = gc->sort_width;
+
+	for(size_t i = 0; i < max_ops; ++i)
+	{
+		if(gc->sort_phase == UGC_SORT_SKIP)
+		{
+			if(nb > 0 && b != list)
+			{
+				b = ugc_next(b);
+				--nb;
+				continue;
+			}
+
+			a = b;
+			na = 0;
+			gc->sort_phase = UGC_SORT_SEEK;
+		}
+		else if(gc->sort_phase == UGC_SORT_SEEK)
+		{
+			if(na < width && b != list)
+			{
+				b = ugc_next(b);
+				++na;
+				continue;
+			}
+
+			if(b != list)
+			{
+				nb = width;
+				gc->sort_merged = 1;
+				gc->sort_phase = UGC_SORT_MERGE;
+				continue;
+			}
+
+			// The last run has nothing to be merged with, this pass is over
+			if(!gc->sort_merged)
+			{
+				gc->sort_width = width;
+				ugc_sort_end(gc);
+				return 0;
+			}
+
+			width *= 2;
+			b = ugc_next(list);
+			nb = 0;
+			gc->sort_merged = 0;
+			gc->sort_phase = UGC_SORT_SKIP;
+		}
+		else if(na == 0 || nb == 0 || b == list)
+		{
+			// Whatever is left of a single run is already in place
+			gc->sort_phase = UGC_SORT_SKIP;
+		}
+		else if((uintptr_t)b < (uintptr_t)a)
+		{
+			ugc_header_t* next = ugc_next(b);
+			ugc_header_t* prev = ugc_prev(a);
+
+			ugc_unlink(b);
+			ugc_set_next(b, a);
+			ugc_set_prev(b, prev);
+			ugc_set_next(prev, b);
+			ugc_set_prev(a, b);
+
+			b = next;
+			--nb;
+		}
+		else
+		{
+			a = ugc_next(a);
+			--na;
+		}
+	}
+
+	gc->sort_a = a;
+	gc->sort_b = b;
+	gc->sort_na = na;
+	gc->sort_nb = nb;
+	gc->sort_width = width;
+
+	return 1;
+#else
+	(void)gc;
+	(void)max_ops;
+	return 0;
+#endif
+}
+
+static void
+ugc_release_set(ugc_t* gc, ugc_header_t* first, ugc_header_t* set)
+{
+	for(ugc_header_t* itr = first; itr != set;)
+	{
+		ugc_header_t* next = ugc_next(itr);
+
+		ugc_release(gc, itr);
+
+		itr = next;
+	}
+}
+
+void
+ugc_init(ugc_t* gc, ugc_visit_fn_t scan_fn, ugc_visit_fn_t release_fn)
+{
+	ugc_clear(&gc->set1);
+	ugc_clear(&gc->set2);
+
+	gc->state = UGC_IDLE;
+	gc->scan_fn = scan_fn;
+	gc->release_fn = release_fn;
+	gc->white = 0;
+	gc->from = &gc->set1;
+	gc->to = &gc->set2;
+	gc->iterator = gc->to;
+	gc->userdata = NULL;
+
+#if UGC_USE_THREADS
+	gc->threads = NULL;
+	gc->handles.next = &gc->handles;
+	gc->handles.prev = &gc->handles;
+	gc->budget = 1;
+	atomic_flag_clear(&gc->thread_lock);
+	atomic_flag_clear(&gc->heap_lock);
+	atomic_init(&gc->safepoint, 0);
+#endif
+
+#if UGC_USE_EPOCHS
+	gc->readers.next = gc->readers.prev = &gc->readers;
+	atomic_init(&gc->num_readers, 0);
+	atomic_init(&gc->epoch, 1);
+	for(int i = 0; i < 3; ++i) { gc->limbo[i] = NULL; }
+#endif
+
+#if UGC_USE_STATS
+	gc->stats = (ugc_stats_t){ .num_cycles = 0 };
+#endif
+
+#if UGC_USE_PERF
+	for(int i = 0; i < UGC_COUNTER_COUNT; ++i) { gc->perf_fds[i] = -1; }
+#endif
+
+#if UGC_USE_CONSERVATIVE
+	gc->index = NULL;
+#endif
+
+#if UGC_USE_FIBERS
+	gc->dirty_fibers.next = gc->dirty_fibers.prev = &gc->dirty_fibers;
+	gc->clean_fibers.next = gc->clean_fibers.prev = &gc->clean_fibers;
+#endif
+
+#if UGC_USE_PINS
+	ugc_pins_init(gc, NULL, 0);
+#endif
+
+#if UGC_USE_WEAK
+	gc->weak_list = UGC_WEAK_END;
+#endif
+
+#if UGC_USE_REGIONS
+	gc->region = NULL;
+#endif
+
+#if UGC_USE_SORT
+	gc->sort_period = 8;
+	gc->sort_cycles = 0;
+	gc->sort_width = 0;
+	ugc_clear(&gc->sort_list);
+#endif
+
+#if UGC_USE_EVACUATION
+	gc->evacuate_fn = NULL;
+	gc->relocate_fn = NULL;
+	gc->num_evacuated = 0;
+#endif
+
+#if UGC_USE_FINALIZERS
+	gc->finalize_fn = NULL;
+	gc->num_finalizers = 0;
+	gc->finalizable.next = gc->finalizable.prev = &gc->finalizable;
+	gc->finalize_queue.next = gc->finalize_queue.prev = &gc->finalize_queue;
+#endif
+
+#if UGC_USE_LARGE
+	gc->large_objects.next = gc->large_objects.prev = &gc->large_objects;
+	gc->large_size = 0;
+	gc->large_registered = 0;
+#endif
+
+#if UGC_USE_LAYOUT
+	gc->layout_offset = 0;
+#endif
+
+#if UGC_USE_PACER
+	gc->pause_target = 500000;
+	gc->cpu_share = 0.25;
+	for(int i = 0; i < UGC_PHASE_COUNT; ++i) { gc->step_cost[i] = 0; }
+	gc->pace_end = 0;
+	gc->pace_credit = 0;
+	gc->num_registered = 0;
+#if UGC_USE_LARGE
+	gc->large_trigger = (size_t)64 << 20;
+#endif
+#endif
+
+#if UGC_USE_PROFILE
+	gc->profile = NULL;
+#endif
+
+#if UGC_USE_RECORD
+	gc->record_fn = NULL;
+#endif
+
+#if UGC_USE_TRACE
+	atomic_init(&gc->trace_head, 0);
+	gc->trace_events = NULL;
+	gc->trace_mask = 0;
+	gc->trace_threshold = 100000;
+#endif
+}
+
+void
+ugc_register(ugc_t* gc, ugc_header_t* obj)
+{
+#if UGC_USE_RECORD
+	ugc_record(gc, UGC_RECORD_REGISTER, obj, NULL);
+#endif
+
+#if UGC_USE_THREADS
+	ugc_lock(&gc->heap_lock);
+#endif
+
+	ugc_push(gc->from, obj);
+	ugc_set_color(obj, gc->white);
+
+#if UGC_USE_PACER
+	++gc->num_registered;
+#endif
+
+#if UGC_USE_THREADS
+	ugc_unlock(&gc->heap_lock);
+#endif
+}
+
+void
+ugc_chain_init(ugc_t* gc, ugc_header_t* chain)
+{
+	ugc_clear(chain);
+	ugc_set_color(chain, gc->white);
+}
+
+void
+ugc_chain_push(ugc_header_t* chain, ugc_header_t* obj)
+{
+	ugc_push(chain, obj);
+	ugc_set_color(obj, ugc_color(chain));
+}
+
+void
+ugc_register_chain(ugc_t* gc, ugc_header_t* chain)
+{
+#if UGC_USE_RECORD
+	if(gc->record_fn != NULL)
+	{
+		for(ugc_header_t* itr = ugc_next(chain); itr != chain; itr = ugc_next(itr))
+		{
+			ugc_record(gc, UGC_RECORD_REGISTER, itr, NULL);
+		}
+	}
+#endif
+
+#if UGC_USE_THREADS
+	ugc_lock(&gc->heap_lock);
+#endif
+
+	ugc_adopt(gc, chain, ugc_color(chain));
+
+#if UGC_USE_THREADS
+	ugc_unlock(&gc->heap_lock);
+#endif
+}
+
+static void
+ugc_merge_index(ugc_t* dst, ugc_t* src)
+{
+#if UGC_USE_CONSERVATIVE
+	ugc_index_t* index = src->index;
+	if(index == NULL) { return; }
+
+	// Each object is added once, from the entry of its first granule
+	for(size_t i = 0; dst->index != NULL && i <= index->mask; ++i)
+	{
+		ugc_index_entry_t* entry = &index->entries[i];
+		if(entry->key == 0) { continue; }
+
+		uintptr_t first = ((uintptr_t)entry->obj >> UGC_INDEX_GRANULE_SHIFT) + 1;
+		if(entry->key == first) { ugc_index_add(dst->index, entry->obj, entry->size); }
+	}
+
+	ugc_index_init(index, index->entries, index->mask + 1);
+#else
+	(void)dst;
+	(void)src;
+#endif
+}
+
+void
+ugc_merge(ugc_t* dst, ugc_t* src)
+{
+	// Objects before the iterator may already be released
+	ugc_sort_end(src);
+	while(src->state == UGC_SWEEP) { ugc_step(src); }
+
+#if UGC_USE_THREADS
+	ugc_lock(&dst->heap_lock);
+#endif
+
+	// "from" only contains white objects while "to" can contain all colors
+	ugc_adopt(dst, src->from, src->white);
+	ugc_adopt(dst, src->to, UGC_GRAY);
+
+	// Gray objects are scanned again by "dst", visiting their containers
+	ugc_finish_weak(src, 0);
+
+#if UGC_USE_LARGE
+	ugc_large_t* large = &src->large_objects;
+	if(large->next != large)
+	{
+		ugc_large_t* tail = dst->large_objects.prev;
+		tail->next = large->next;
+		large->next->prev = tail;
+		large->prev->next = &dst->large_objects;
+		dst->large_objects.prev = large->prev;
+		large->next = large->prev = large;
+	}
+	dst->large_size += src->large_size;
+	src->large_size = 0;
+#endif
+
+#if UGC_USE_FINALIZERS
+	ugc_finalizable_t* lists[2][2] = {
+		{ &src->finalizable, &dst->finalizable },
+		{ &src->finalize_queue, &dst->finalize_queue },
+	};
+	for(int i = 0; i < 2; ++i)
+	{
+		ugc_finalizable_t* from = lists[i][0];
+		ugc_finalizable_t* into = lists[i][1];
+		if(from->next == from) { continue; }
+
+		from->next->prev = into->prev;
+		into->prev->next = from->next;
+		from->prev->next = into;
+		into->prev = from->prev;
+		from->next = from->prev = from;
+	}
+	dst->num_finalizers += src->num_finalizers;
+	src->num_finalizers = 0;
+#endif
+
+	ugc_merge_index(dst, src);
+
+#if UGC_USE_THREADS
+	ugc_unlock(&dst->heap_lock);
+#endif
+
+	src->iterator = src->to;
+	src->state = UGC_IDLE;
+}
+
+void
+ugc_release_all(ugc_t* gc)
+{
+#if UGC_USE_RECORD
+	ugc_record(gc, UGC_RECORD_RELEASE_ALL, NULL, NULL);
+#endif
+
+	// Containers may be released along with their objects
+	ugc_finish_weak(gc, 0);
+	ugc_sort_end(gc);
+
+	ugc_release_set(gc, ugc_next(gc->from), gc->from);
+
+	// Objects before the iterator were already released by the sweep phase
+	ugc_header_t* to = gc->to;
+	ugc_release_set(gc, gc->state == UGC_SWEEP ? gc->iterator : ugc_next(to), to);
+
+#if UGC_USE_THREADS
+	for(ugc_thread_t* itr = gc->threads; itr != NULL; itr = itr->next)
+	{
+		ugc_release_set(gc, ugc_next(&itr->local), &itr->local);
+	}
+#endif
+
+#if UGC_USE_EPOCHS
+	for(unsigned int i = 0; i < 3; ++i) { ugc_release_limbo(gc, i); }
+#endif
+
+#if UGC_USE_LARGE
+	gc->large_objects.next = gc->large_objects.prev = &gc->large_objects;
+	gc->large_size = 0;
+#endif
+
+#if UGC_USE_REGIONS
+	if(gc->region != NULL)
+	{
+		ugc_header_t* list = &gc->region->objects;
+		ugc_release_set(gc, ugc_next(list), list);
+		ugc_clear(list);
+	}
+#endif
+
+#if UGC_USE_FINALIZERS
+	gc->num_finalizers = 0;
+	gc->finalizable.next = gc->finalizable.prev = &gc->finalizable;
+	gc->finalize_queue.next = gc->finalize_queue.prev = &gc->finalize_queue;
+#endif
+}
+
+void
+ugc_write_barrier(
+	ugc_t* gc,
+	enum ugc_barrier_direction_e direction,
+	ugc_header_t* parent,
+	ugc_header_t* child
+)
+{
+#if UGC_USE_RECORD
+	ugc_record(
+		gc,
+		direction == UGC_BARRIER_FORWARD
+			? UGC_RECORD_BARRIER_FORWARD
+			: UGC_RECORD_BARRIER_BACKWARD,
+		parent,
+		child
+	);
+#endif
+
+#if UGC_USE_THREADS
+#if !UGC_USE_REGIONS
+	// Black objects only exist during the mark phase and the state can only
+	// change while all threads are at a safepoint.
+	if(gc->state != UGC_MARK) { return; }
+#endif
+
+	ugc_lock(&gc->heap_lock);
+#endif
+
+	unsigned char white = gc->white;
+	unsigned char black = !gc->white;
+	unsigned char parent_color = ugc_color(parent);
+
+#if UGC_USE_REGIONS
+	if(ugc_color(child) == UGC_REGION && parent_color != UGC_REGION) { ++gc->region->num_escapes; }
+
+	// Region objects cannot be grayed but they are never rescanned either
+	if(parent_color == UGC_REGION && gc->state == UGC_MARK)
+	{
+		direction = UGC_BARRIER_FORWARD;
+		parent_color = black;
+	}
+#endif
+
+	if(parent_color == black && ugc_color(child) == white)
+	{
+		switch(direction)
+		{
+			case UGC_BARRIER_FORWARD:
+				ugc_make_gray(gc, child);
+				break;
+			case UGC_BARRIER_BACKWARD:
+				ugc_make_gray(gc, parent);
+				break;
+		}
+
+#if UGC_USE_TRACE
+		ugc_trace_emit(gc, UGC_TRACE_BARRIER, 'i', UGC_CLOCK(), 0);
+#endif
+	}
+
+#if UGC_USE_THREADS
+	ugc_unlock(&gc->heap_lock);
+#endif
+}
+
+void
+ugc_visit(ugc_t* gc, ugc_header_t* obj)
+{
+#if UGC_USE_PROFILE
+	if(gc->profile != NULL)
+	{
+		ugc_profile_visit(gc->profile, obj);
+		return;
+	}
+#endif
+
+#if UGC_USE_RECORD
+	ugc_record(gc, UGC_RECORD_EDGE, obj, NULL);
+#endif
+
+	if(ugc_color(obj) == gc->white)
+	{
+		ugc_make_gray(gc, obj);
+	}
+}
+
+#if UGC_USE_LARGE
+
+void
+ugc_register_large(ugc_t* gc, ugc_large_t* obj, size_t size)
+{
+	ugc_register(gc, &obj->header);
+
+#if UGC_USE_THREADS
+	ugc_lock(&gc->heap_lock);
+#endif
+
+	obj->size = size;
+	obj->next = &gc->large_objects;
+	obj->prev = gc->large_objects.prev;
+	gc->large_objects.prev->next = obj;
+	gc->large_objects.prev = obj;
+	gc->large_size += size;
+	gc->large_registered += size;
+
+#if UGC_USE_THREADS
+	ugc_unlock(&gc->heap_lock);
+#endif
+}
+
+#endif
+
+#if UGC_USE_REGIONS
+
+void
+ugc_region_open(ugc_t* gc, ugc_region_t* region)
+{
+	ugc_clear(&region->objects);
+	region->num_escapes = 0;
+	gc->region = region;
+}
+
+void
+ugc_register_region(ugc_t* gc, ugc_header_t* obj)
+{
+#if UGC_USE_THREADS
+	ugc_lock(&gc->heap_lock);
+#endif
+
+	ugc_push(&gc->region->objects, obj);
+	ugc_set_color(obj, UGC_REGION);
+
+	// The root scan which covers the region is over
+	if(gc->state == UGC_MARK) { ugc_scan(gc, obj); }
+
+#if UGC_USE_THREADS
+	ugc_unlock(&gc->heap_lock);
+#endif
+}
+
+int
+ugc_region_close(ugc_t* gc)
+{
+#if UGC_USE_THREADS
+	// Write barriers count escapes and registrations push to the list under
+	// the lock
+	ugc_lock(&gc->heap_lock);
+#endif
+
+	ugc_region_t* region = gc->region;
+	ugc_header_t* list = &region->objects;
+	gc->region = NULL;
+
+	// Containers visited while scanning the region are linked in the weak
+	// list until the mark phase ends
+	int scanned = UGC_USE_WEAK && gc->state == UGC_MARK;
+
+	if(region->num_escapes == 0 && !scanned)
+	{
+#if UGC_USE_THREADS
+		// The region is detached, nothing else can reach its objects
+		ugc_unlock(&gc->heap_lock);
+#endif
+
+		ugc_release_set(gc, ugc_next(list), list);
+		return 1;
+	}
+
+	// Like any object registered during the current phase. During the mark
+	// phase, they must survive as they were black.
+	unsigned char white = gc->white;
+	for(ugc_header_t* itr = ugc_next(list); itr != list; itr = ugc_next(itr))
+	{
+		ugc_set_color(itr, white);
+	}
+	ugc_adopt(gc, list, gc->state == UGC_MARK ? UGC_GRAY : white);
+
+#if UGC_USE_THREADS
+	ugc_unlock(&gc->heap_lock);
+#endif
+
+	return 0;
+}
+
+#endif
+
+#if UGC_USE_FINALIZERS
+
+void
+ugc_register_finalizable(ugc_t* gc, ugc_finalizable_t* obj)
+{
+	ugc_register(gc, &obj->header);
+
+#if UGC_USE_THREADS
+	ugc_lock(&gc->heap_lock);
+#endif
+
+	obj->next = &gc->finalizable;
+	obj->prev = gc->finalizable.prev;
+	gc->finalizable.prev->next = obj;
+	gc->finalizable.prev = obj;
+
+#if UGC_USE_THREADS
+	ugc_unlock(&gc->heap_lock);
+#endif
+}
+
+size_t
+ugc_finalize(ugc_t* gc, size_t max_objects)
+{
+	size_t num_finalized = 0;
+	ugc_finalizable_t* queue = &gc->finalize_queue;
+
+	while(num_finalized < max_objects)
+	{
+#if UGC_USE_THREADS
+		ugc_lock(&gc->heap_lock);
+#endif
+
+		// Once out of the queue, the object is an ordinary one
+		ugc_finalizable_t* obj = queue->next;
+		if(obj != queue)
+		{
+			queue->next = obj->next;
+			obj->next->prev = queue;
+			--gc->num_finalizers;
+		}
+
+#if UGC_USE_THREADS
+		ugc_unlock(&gc->heap_lock);
+#endif
+
+		if(obj == queue) { break; }
+
+		gc->finalize_fn(gc, &obj->header);
+		++num_finalized;
+	}
+
+	return num_finalized;
+}
+
+#endif
+
+#if UGC_USE_EVACUATION
+
+ugc_header_t*
+ugc_forward(ugc_t* gc, ugc_header_t* obj)
+{
+	(void)gc;
+	return ugc_color(obj) == UGC_GRAY ? ugc_prev(obj) : obj;
+}
+
+#endif
+
+#if UGC_USE_WEAK
+
+void
+ugc_weak_init(ugc_weak_t* weak, ugc_header_t** refs, ugc_header_t** values, size_t size)
+{
+	weak->refs = refs;
+	weak->values = values;
+	weak->size = size;
+	weak->num_cleared = 0;
+	weak->next = NULL;
+}
+
+void
+ugc_visit_weak(ugc_t* gc, ugc_weak_t* weak)
+{
+#if UGC_USE_PROFILE
+	// Weak references do not retain anything
+	if(gc->profile != NULL) { return; }
+#endif
+
+	// Containers of roots are visited on every rescan
+	if(weak->next != NULL) { return; }
+
+	weak->next = gc->weak_list;
+	gc->weak_list = weak;
+}
+
+#endif
+
+void
+ugc_step(ugc_t* gc)
+{
+	ugc_header_t* obj;
+	ugc_header_t* to = gc->to;
+
+	ugc_flush_threads(gc);
+
+#if UGC_USE_STATS || UGC_USE_TRACE
+	enum ugc_phase_e phase = ugc_phase(gc);
+#endif
+
+#if UGC_USE_PERF
+	// Read counters outside of the timed region as it takes a syscall
+	uint64_t counters[UGC_COUNTER_COUNT];
+	ugc_perf_read(gc, counters);
+#endif
+
+#if UGC_USE_STATS || UGC_USE_TRACE
+	uint64_t start = UGC_CLOCK();
+#endif
+
+#if UGC_USE_STATS
+	if(phase == UGC_PHASE_ROOT) { ugc_stats_begin_cycle(gc, start); }
+#endif
+
+	switch((enum ugc_state_e)gc->state)
+	{
+		case UGC_IDLE:
+#if UGC_USE_EPOCHS
+			ugc_reclaim(gc);
+#endif
+#if UGC_USE_LARGE
+			gc->large_registered = 0;
+#endif
+			ugc_scan_roots(gc, UGC_ROOTS_INITIAL);
+			gc->state = UGC_MARK;
+			break;
+		case UGC_MARK:
+			{
+				obj = ugc_next(gc->iterator);
+				unsigned char white = gc->white;
+
+				if(obj != to)
+				{
+					gc->iterator = obj;
+					ugc_set_color(obj, !white);
+#if UGC_USE_RECORD
+					ugc_record(gc, UGC_RECORD_SCAN, obj, NULL);
+#endif
+					ugc_scan(gc, obj);
+				}
+				else if(ugc_pins_pending(gc))
+				{
+					ugc_scan_pins(gc, UGC_PIN_SCAN_CHUNK);
+				}
+				else
+				{
+					ugc_scan_roots(gc, UGC_ROOTS_RESCAN);
+					obj = ugc_next(gc->iterator);
+					if(obj == to && !ugc_mark_ephemerons(gc) && !ugc_resurrect(gc))
+					{
+						ugc_finish_mark(gc);
+						ugc_sort_begin(gc);
+					}
+				}
+			}
+			break;
+		case UGC_SWEEP:
+			obj = gc->iterator;
+			if(obj != to)
+			{
+				gc->iterator = ugc_next(obj);
+				ugc_release(gc, obj);
+				ugc_sort(gc, UGC_SORT_CHUNK);
+			}
+			else if(!ugc_sort(gc, UGC_SORT_CHUNK))
+			{
+				ugc_clear(to);
+				gc->state = UGC_IDLE;
+#if UGC_USE_EPOCHS
+				ugc_reclaim(gc);
+#endif
+			}
+			break;
+	}
+
+#if UGC_USE_RECORD
+	// Edges reported during the step are recorded before the step itself so
+	// that a replay knows them beforehand.
+	ugc_record(gc, UGC_RECORD_STEP, NULL, NULL);
+#endif
+
+#if UGC_USE_STATS || UGC_USE_TRACE
+	uint64_t end = UGC_CLOCK();
+#endif
+
+#if UGC_USE_PERF
+	uint64_t counters_end[UGC_COUNTER_COUNT];
+	ugc_perf_read(gc, counters_end);
+	for(int i = 0; i < UGC_COUNTER_COUNT; ++i)
+	{
+		gc->stats.counters[phase][i] += counters_end[i] - counters[i];
+	}
+#endif
+
+#if UGC_USE_STATS
+	ugc_histogram_record(&gc->stats.steps[phase], end - start);
+	gc->stats.cycle_work += end - start;
+	if(gc->state == UGC_IDLE) { ugc_stats_end_cycle(gc, end); }
+#endif
+
+#if UGC_USE_TRACE
+	ugc_trace_step(gc, phase, start, end);
+#endif
+}
+
+void
+ugc_collect(ugc_t* gc)
+{
+	if(gc->state == UGC_IDLE) { ugc_step(gc); }
+	while(gc->state != UGC_IDLE) { ugc_step(gc); }
+}
+
+#if UGC_USE_PACER
+
+void
+ugc_pace(ugc_t* gc)
+{
+	uint64_t start = UGC_CLOCK();
+	if(gc->pace_end == 0) { gc->pace_end = start; }
+
+	// The credit goes negative when the collector needs more than its share to
+	// keep up, it is repaid before starting another cycle
+	// A share of 1 would earn an infinite credit
+	double share = gc->cpu_share;
+	if(!(share >= 0.0)) { share = 0.0; }
+	if(share > 0.99) { share = 0.99; }
+	uint64_t mutator_time = start - gc->pace_end;
+	int64_t credit = gc->pace_credit + (int64_t)((double)mutator_time * share / (1.0 - share));
+
+	// Each new object is scanned and released at most once per cycle. The
+	// factor of 2 leaves room for the root rescans of mark termination.
+	uint64_t* cost = gc->step_cost;
+	uint64_t needed = 2 * gc->num_registered * (cost[UGC_PHASE_MARK] + cost[UGC_PHASE_SWEEP]);
+	uint64_t budget = credit > 0 ? (uint64_t)credit : 0;
+	if(gc->state != UGC_IDLE && budget < needed) { budget = needed; }
+	if(budget > gc->pause_target) { budget = gc->pause_target; }
+
+	int start_cycle = gc->num_registered > 0 && credit >= (int64_t)cost[UGC_PHASE_ROOT];
+#if UGC_USE_LARGE
+	// The memory they hold is worth more than keeping to the CPU share
+	if(gc->large_registered >= gc->large_trigger) { start_cycle = 1; }
+#endif
+
+	uint64_t now = start;
+	if(gc->state != UGC_IDLE || start_cycle)
+	{
+		do
+		{
+			enum ugc_phase_e phase = ugc_phase(gc);
+
+			// A root rescan is wasted if the mutator runs before the next one
+			// as it will likely find new objects. Once started, finishing the
+			// mark phase is worth the whole pause.
+			if(phase == UGC_PHASE_TERMINATION) { budget = gc->pause_target; }
+
+			// Always make progress
+			if(now != start && now - start + cost[phase] > budget) { break; }
+
+			ugc_step(gc);
+
+			uint64_t end = UGC_CLOCK();
+			int64_t sample = (int64_t)(end - now);
+			cost[phase] = cost[phase] == 0
+				? (uint64_t)sample
+				: (uint64_t)((int64_t)cost[phase] + (sample - (int64_t)cost[phase]) / 8);
+			now = end;
+		} while(now - start < budget && gc->state != UGC_IDLE);
+	}
+
+	// Do not save up for a pause longer than the target
+	credit -= (int64_t)(now - start);
+	gc->pace_credit = credit < (int64_t)gc->pause_target ? credit : (int64_t)gc->pause_target;
+	gc->pace_end = now;
+
+	// Objects registered while idle are accounted for in the next cycle
+	if(now != start) { gc->num_registered = 0; }
+}
+
+#endif
+
+void
+ugc_collect_full(ugc_t* gc)
+{
+	// Objects registered locally during the mark phase are gray, they must be
+	// moved to "to" before the mark phase is abandoned.
+	ugc_flush_threads(gc);
+
+	// Everything left to sweep is already known to be garbage
+	ugc_sort_end(gc);
+	while(gc->state == UGC_SWEEP) { ugc_step(gc); }
+
+	if(gc->state == UGC_MARK)
+	{
+		// Objects marked so far might have become garbage since. Restarting is
+		// cheaper than finishing this cycle then running another one.
+		ugc_header_t* to = gc->to;
+		for(ugc_header_t* itr = ugc_next(to); itr != to; itr = ugc_next(itr))
+		{
+			ugc_set_color(itr, gc->white);
+		}
+
+		ugc_splice(gc->from, to);
+		gc->iterator = to;
+		gc->state = UGC_IDLE;
+		ugc_finish_weak(gc, 0);
+
+#if UGC_USE_TRACE
+		// Close the phases opened by ugc_step
+		uint64_t now = UGC_CLOCK();
+		ugc_trace_emit(gc, UGC_TRACE_MARK, 'E', now, 0);
+		ugc_trace_emit(gc, UGC_TRACE_CYCLE, 'E', now, 0);
+#endif
+	}
+
+#if UGC_USE_STATS || UGC_USE_TRACE
+	uint64_t start = UGC_CLOCK();
+#endif
+
+#if UGC_USE_STATS
+	ugc_stats_begin_cycle(gc, start);
+#endif
+
+	// Nothing can modify the object graph from here so there is no need to
+	// scan the root more than once.
+	gc->state = UGC_MARK;
+	ugc_scan_roots(gc, UGC_ROOTS_INITIAL);
+	ugc_scan_pins(gc, SIZE_MAX);
+
+	ugc_header_t* to = gc->to;
+	unsigned char black = !gc->white;
+	do
+	{
+		for(ugc_header_t* obj = ugc_next(gc->iterator); obj != to; obj = ugc_next(obj))
+		{
+			gc->iterator = obj;
+			ugc_set_color(obj, black);
+#if UGC_USE_RECORD
+			ugc_record(gc, UGC_RECORD_SCAN, obj, NULL);
+#endif
+			ugc_scan(gc, obj);
+		}
+	} while(ugc_mark_ephemerons(gc) || ugc_resurrect(gc));
+
+	ugc_finish_mark(gc);
+
+	ugc_release_set(gc, ugc_next(gc->to), gc->to);
+	ugc_clear(gc->to);
+	gc->iterator = gc->to;
+	gc->state = UGC_IDLE;
+
+#if UGC_USE_EPOCHS
+	ugc_reclaim(gc);
+#endif
+
+#if UGC_USE_RECORD
+	ugc_record(gc, UGC_RECORD_COLLECT_FULL, NULL, NULL);
+#endif
+
+#if UGC_USE_STATS || UGC_USE_TRACE
+	uint64_t end = UGC_CLOCK();
+#endif
+
+#if UGC_USE_STATS
+	gc->stats.cycle_work = end - start;
+	ugc_stats_end_cycle(gc, end);
+#endif
+
+#if UGC_USE_TRACE
+	ugc_trace_emit(gc, UGC_TRACE_COLLECT_FULL, 'X', start, end - start);
+#endif
+}
+
+#if UGC_USE_TRACE
+
+void
+ugc_trace_init(ugc_t* gc, ugc_trace_event_t* events, size_t capacity)
+{
+	for(size_t i = 0; i < capacity; ++i)
+	{
+		atomic_init(&events[i].sequence, 0);
+	}
+
+	gc->trace_events = capacity > 0 ? events : NULL;
+	gc->trace_mask = capacity - 1;
+	atomic_store(&gc->trace_head, 0);
+}
+
+void
+ugc_trace_dump(ugc_t* gc, ugc_write_fn_t write_fn, void* ctx)
+{
+	static const char* names[] = {
+		"cycle",
+		"root_scan",
+		"mark",
+		"termination",
+		"large_scan",
+		"sweep",
+		"barrier",
+		"collect_full",
+	};
+	static const char header[] = "{\"traceEvents\":[";
+	static const char footer[] = "\n]}\n";
+
+	write_fn(ctx, header, sizeof(header) - 1);
+
+	size_t end = atomic_load(&gc->trace_head);
+	size_t capacity = gc->trace_events != NULL ? gc->trace_mask + 1 : 0;
+	size_t begin = end > capacity ? end - capacity : 0;
+	int first = 1;
+
+	for(size_t index = begin; index < end; ++index)
+	{
+		ugc_trace_event_t* slot = &gc->trace_events[index & gc->trace_mask];
+		if(atomic_load_explicit(&slot->sequence, memory_order_acquire) != index + 1)
+		{
+			continue;
+		}
+
+		ugc_trace_event_t event;
+		event.timestamp = slot->timestamp;
+		event.duration = slot->duration;
+		event.type = slot->type;
+		event.phase = slot->phase;
+
+		atomic_thread_fence(memory_order_acquire);
+		if(atomic_load_explicit(&slot->sequence, memory_order_relaxed) != index + 1)
+		{
+			continue;
+		}
+
+		char buf[192];
+		int len = snprintf(
+			buf, sizeof(buf),
+			"%s\n{\"name\":\"%s\",\"cat\":\"gc\",\"ph\":\"%c\",\"pid\":1,\"tid\":1,"
+			"\"ts\":%llu.%03u",
+			first ? "" : ",",
+			names[event.type],
+			event.phase,
+			(unsigned long long)(event.timestamp / 1000),
+			(unsigned int)(event.timestamp % 1000)
+		);
+
+		if(event.phase == 'X')
+		{
+			len += snprintf(
+				buf + len, sizeof(buf) - len,
+				",\"dur\":%llu.%03u",
+				(unsigned long long)(event.duration / 1000),
+				(unsigned int)(event.duration % 1000)
+			);
+		}
+		else if(event.phase == 'i')
+		{
+			len += snprintf(buf + len, sizeof(buf) - len, ",\"s\":\"t\"");
+		}
+
+		len += snprintf(buf + len, sizeof(buf) - len, "}");
+		write_fn(ctx, buf, (size_t)len);
+		first = 0;
+	}
+
+	write_fn(ctx, footer, sizeof(footer) - 1);
+}
+
+#endif
+
+#if UGC_USE_STATS
+
+uint64_t
+ugc_histogram_percentile(const ugc_histogram_t* histogram, double percentile)
+{
+	// Nearest rank: the value at index ceil(percentile * count) - 1
+	double rank = (double)histogram->count * percentile;
+	uint64_t threshold = rank > 1.0 ? (uint64_t)rank : 1;
+	if((double)threshold < rank) { ++threshold; }
+	uint64_t count = 0;
+
+	for(unsigned int i = 0; i < UGC_HISTOGRAM_NUM_BUCKETS - 1; ++i)
+	{
+		count += histogram->buckets[i];
+		if(count >= threshold)
+		{
+			uint64_t upper_bound = ugc_histogram_value(i + 1) - 1;
+			return upper_bound < histogram->max ? upper_bound : histogram->max;
+		}
+	}
+
+	return histogram->max;
+}
+
+void
+ugc_stats_reset(ugc_t* gc)
+{
+	uint64_t cycle_start = gc->stats.cycle_start;
+	uint64_t cycle_work = gc->stats.cycle_work;
+	gc->stats = (ugc_stats_t){ .num_cycles = 0 };
+
+	// Keep track of the current cycle
+	gc->stats.cycle_start = cycle_start;
+	gc->stats.cycle_work = cycle_work;
+}
+
+#endif
+
+#if UGC_USE_RECORD
+
+void
+ugc_record_start(ugc_t* gc, ugc_write_fn_t write_fn, void* ctx)
+{
+	ugc_record_stop(gc);
+
+	gc->record_fn = write_fn;
+	gc->record_ctx = ctx;
+	gc->record_last = 0;
+	gc->record_size = sizeof(UGC_RECORD_MAGIC) - 1;
+	memcpy(gc->record_buf, UGC_RECORD_MAGIC, gc->record_size);
+}
+
+void
+ugc_record_flush(ugc_t* gc)
+{
+	if(gc->record_fn == NULL || gc->record_size == 0) { return; }
+
+	gc->record_fn(gc->record_ctx, gc->record_buf, gc->record_size);
+	gc->record_size = 0;
+}
+
+void
+ugc_record_stop(ugc_t* gc)
+{
+	ugc_record_flush(gc);
+	gc->record_fn = NULL;
+}
+
+int
+ugc_record_reader_init(ugc_record_reader_t* reader, const void* data, size_t size)
+{
+	size_t magic_size = sizeof(UGC_RECORD_MAGIC) - 1;
+	if(size < magic_size || memcmp(data, UGC_RECORD_MAGIC, magic_size) != 0)
+	{
+		return -1;
+	}
+
+	reader->data = (const unsigned char*)data + magic_size;
+	reader->end = (const unsigned char*)data + size;
+	reader->last = 0;
+	return 0;
+}
+
+static int
+ugc_record_read_obj(ugc_record_reader_t* reader, uintptr_t* id)
+{
+	uint64_t value = 0;
+	unsigned int shift = 0;
+
+	for(;;)
+	{
+		if(reader->data == reader->end || shift >= 64) { return -1; }
+
+		unsigned char byte = *reader->data++;
+		value |= (uint64_t)(byte & 0x7f) << shift;
+		shift += 7;
+		if((byte & 0x80) == 0) { break; }
+	}
+
+	uintptr_t delta = (value & 1) ? ~(uintptr_t)(value >> 1) : (uintptr_t)(value >> 1);
+	reader->last += delta;
+	*id = reader->last;
+	return 0;
+}
+
+int
+ugc_record_read(ugc_record_reader_t* reader, ugc_record_op_t* op)
+{
+	if(reader->data == reader->end) { return 0; }
+
+	op->type = (enum ugc_record_type_e)*reader->data++;
+	op->obj = 0;
+	op->child = 0;
+
+	switch(op->type)
+	{
+		case UGC_RECORD_BARRIER_FORWARD:
+		case UGC_RECORD_BARRIER_BACKWARD:
+			if(ugc_record_read_obj(reader, &op->obj) != 0) { return -1; }
+			return ugc_record_read_obj(reader, &op->child) == 0 ? 1 : -1;
+		case UGC_RECORD_REGISTER:
+		case UGC_RECORD_SCAN:
+		case UGC_RECORD_EDGE:
+			return ugc_record_read_obj(reader, &op->obj) == 0 ? 1 : -1;
+		case UGC_RECORD_STEP:
+		case UGC_RECORD_COLLECT_FULL:
+		case UGC_RECORD_RELEASE_ALL:
+		case UGC_RECORD_SCAN_ROOTS:
+		case UGC_RECORD_RESCAN_ROOTS:
+			return 1;
+	}
+
+	return -1;
+}
+
+#endif
+
+#if UGC_USE_PROFILE
+
+void
+ugc_profile_init(
+	ugc_profile_t* profile,
+	ugc_profile_node_t* nodes, size_t max_nodes,
+	size_t* edges, size_t max_edges
+)
+{
+	profile->nodes = nodes;
+	profile->num_nodes = 0;
+	profile->max_nodes = max_nodes;
+	profile->edges = edges;
+	profile->num_edges = 0;
+	profile->max_edges = max_edges;
+	profile->current = 0;
+	profile->overflow = 0;
+}
+
+int
+ugc_profile_take(ugc_t* gc, ugc_profile_t* profile, ugc_describe_fn_t describe_fn)
+{
+	ugc_profile_init(
+		profile,
+		profile->nodes, profile->max_nodes,
+		profile->edges, profile->max_edges
+	);
+	if(profile->max_nodes == 0) { return -1; }
+
+	ugc_profile_node_t* root = &profile->nodes[0];
+	*root = (ugc_profile_node_t){ .obj = NULL };
+	profile->num_nodes = 1;
+
+	// The node array doubles as the queue of a breadth-first traversal
+	gc->profile = profile;
+	for(size_t i = 0; i < profile->num_nodes && !profile->overflow; ++i)
+	{
+		ugc_profile_node_t* node = &profile->nodes[i];
+		profile->current = i;
+		node->first_edge = profile->num_edges;
+
+		if(i == 0)
+		{
+			ugc_visit_roots(gc, UGC_ROOTS_ALL);
+		}
+		else
+		{
+			ugc_scan(gc, node->obj);
+		}
+	}
+	gc->profile = NULL;
+
+	for(size_t i = 1; i < profile->num_nodes; ++i)
+	{
+		ugc_profile_node_t* node = &profile->nodes[i];
+		node->obj->prev = node->prev;
+	}
+
+	if(profile->overflow) { return -1; }
+
+	root->size = 0;
+	for(size_t i = 1; i < profile->num_nodes; ++i)
+	{
+		describe_fn(gc, &profile->nodes[i]);
+	}
+
+	ugc_profile_dominators(profile);
+
+	// Dominators come first so their retained size is complete once all the
+	// nodes after them are processed
+	for(size_t i = 0; i < profile->num_nodes; ++i)
+	{
+		profile->nodes[i].retained = profile->nodes[i].size;
+	}
+
+	for(size_t i = profile->num_nodes - 1; i > 0; --i)
+	{
+		ugc_profile_node_t* node = &profile->nodes[i];
+		profile->nodes[node->dominator].retained += node->retained;
+	}
+
+	return 0;
+}
+
+void
+ugc_profile_aggregate(
+	const ugc_profile_t* profile,
+	ugc_profile_type_t* types, size_t num_types
+)
+{
+	for(size_t i = 0; i < num_types; ++i)
+	{
+		types[i] = (ugc_profile_type_t){ .count = 0 };
+	}
+
+	for(size_t i = 1; i < profile->num_nodes; ++i)
+	{
+		const ugc_profile_node_t* node = &profile->nodes[i];
+		if(node->type >= num_types) { continue; }
+
+		ugc_profile_type_t* type = &types[node->type];
+		++type->count;
+		type->size += node->size;
+
+		// Do not count the same objects twice (e.g: the nodes of a list)
+		const ugc_profile_node_t* dominator = &profile->nodes[node->dominator];
+		if(node->dominator == 0 || dominator->type != node->type)
+		{
+			type->retained += node->retained;
+		}
+	}
+}
+
+static void
+ugc_profile_string(ugc_write_fn_t write_fn, void* ctx, const char* str)
+{
+	write_fn(ctx, "\"", 1);
+	for(const char* itr = str; *itr != '\0'; ++itr)
+	{
+		if(*itr == '"' || *itr == '\\') { write_fn(ctx, "\\", 1); }
+		write_fn(ctx, itr, 1);
+	}
+	write_fn(ctx, "\"", 1);
+}
+
+void
+ugc_profile_write(
+	const ugc_profile_t* profile,
+	const char* const* type_names, size_t num_types,
+	ugc_write_fn_t write_fn, void* ctx
+)
+{
+	static const char header[] =
+		"{\"snapshot\":{\"meta\":{"
+		"\"node_fields\":[\"type\",\"name\",\"id\",\"self_size\",\"edge_count\",\"trace_node_id\"],"
+		"\"node_types\":[[\"hidden\",\"array\",\"string\",\"object\",\"code\",\"closure\","
+		"\"regexp\",\"number\",\"native\",\"synthetic\"],"
+		"\"string\",\"number\",\"number\",\"number\",\"number\"],"
+		"\"edge_fields\":[\"type\",\"name_or_index\",\"to_node\"],"
+		"\"edge_types\":[[\"context\",\"element\",\"property\",\"internal\",\"hidden\","
+		"\"shortcut\",\"weak\"],\"string_or_number\",\"node\"],"
+		"\"trace_function_info_fields\":[],\"trace_node_fields\":[],"
+		"\"sample_fields\":[],\"location_fields\":[]},";
+	char buf[128];
+	int len;
+
+	write_fn(ctx, header, sizeof(header) - 1);
+	len = snprintf(
+		buf, sizeof(buf),
+		"\"node_count\":%zu,\"edge_count\":%zu,\"trace_function_count\":0},\n\"nodes\":[",
+		profile->num_nodes, profile->num_edges
+	);
+	write_fn(ctx, buf, (size_t)len);
+
+	// String 0 is the root, then type names, then a name for unknown types
+	for(size_t i = 0; i < profile->num_nodes; ++i)
+	{
+		const ugc_profile_node_t* node = &profile->nodes[i];
+		size_t name = i == 0 ? 0 : node->type < num_types ? node->type + 1 : num_types + 1;
+		len = snprintf(
+			buf, sizeof(buf),
+			"%s%d,%zu,%zu,%zu,%zu,0",
+			i == 0 ? "" : ",\n",
+			i == 0 ? 9 : 3,
+			name,
+			i * 2 + 1,
+			node->size,
+			node->num_edges
+		);
+		write_fn(ctx, buf, (size_t)len);
+	}
+
+	write_fn(ctx, "],\n\"edges\":[", 12);
+	for(size_t i = 0; i < profile->num_nodes; ++i)
+	{
+		const ugc_profile_node_t* node = &profile->nodes[i];
+		for(size_t j = 0; j < node->num_edges; ++j)
+		{
+			len = snprintf(
+				buf, sizeof(buf),
+				"%s1,%zu,%zu",
+				node->first_edge + j == 0 ? "" : ",\n",
+				j,
+				// Edges point to the offset of the node in the "nodes" array
+				profile->edges[node->first_edge + j] * 6
+			);
+			write_fn(ctx, buf, (size_t)len);
+		}
+	}
+
+	static const char strings[] =
+		"],\n\"trace_function_infos\":[],\"trace_tree\":[],\"samples\":[],\"locations\":[],"
+		"\n\"strings\":[\"(GC roots)\"";
+	write_fn(ctx, strings, sizeof(strings) - 1);
+	for(size_t i = 0; i < num_types; ++i)
+	{
+		write_fn(ctx, ",", 1);
+		ugc_profile_string(write_fn, ctx, type_names[i]);
+	}
+
+	static const char footer[] = ",\"(unknown)\"]}\n";
+	write_fn(ctx, footer, sizeof(footer) - 1);
+}
+
+#endif
+
+#if UGC_USE_PERF
+
+int
+ugc_perf_open(ugc_t* gc)
+{
+	static const uint64_t configs[UGC_COUNTER_COUNT] = {
+		PERF_COUNT_HW_CPU_CYCLES,
+		PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_CACHE_MISSES,
+		PERF_COUNT_HW_BRANCH_MISSES,
+	};
+
+	ugc_perf_close(gc);
+
+	int group = -1;
+	for(int i = 0; i < UGC_COUNTER_COUNT; ++i)
+	{
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.size = sizeof(attr);
+		attr.config = configs[i];
+		attr.read_format = PERF_FORMAT_GROUP;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+
+		int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+		gc->perf_fds[i] = fd;
+		if(group < 0) { group = fd; }
+	}
+
+	return group >= 0 ? 0 : -1;
+}
+
+void
+ugc_perf_close(ugc_t* gc)
+{
+	// Close the group leader last
+	for(int i = UGC_COUNTER_COUNT - 1; i >= 0; --i)
+	{
+		if(gc->perf_fds[i] >= 0) { close(gc->perf_fds[i]); }
+		gc->perf_fds[i] = -1;
+	}
+}
+
+#endif
+
+#if UGC_USE_FIBERS
+
+void
+ugc_fiber_add(ugc_t* gc, ugc_fiber_t* fiber, ugc_fiber_scan_fn_t scan_fn)
+{
+	fiber->scan_fn = scan_fn;
+	fiber->state = UGC_FIBER_DIRTY;
+
+#if UGC_USE_THREADS
+	ugc_lock(&gc->heap_lock);
+#endif
+	ugc_fiber_push(&gc->dirty_fibers, fiber);
+#if UGC_USE_THREADS
+	ugc_unlock(&gc->heap_lock);
+#endif
+}
+
+void
+ugc_fiber_remove(ugc_t* gc, ugc_fiber_t* fiber)
+{
+#if UGC_USE_THREADS
+	ugc_lock(&gc->heap_lock);
+#else
+	(void)gc;
+#endif
+	ugc_fiber_unlink(fiber);
+#if UGC_USE_THREADS
+	ugc_unlock(&gc->heap_lock);
+#endif
+}
+
+void
+ugc_fiber_resume(ugc_t* gc, ugc_fiber_t* fiber)
+{
+	// The state of a fiber only changes during a root scan while it is not
+	// running, or on the thread running it
+	if(fiber->state == UGC_FIBER_CLEAN)
+	{
+#if UGC_USE_THREADS
+		ugc_lock(&gc->heap_lock);
+#endif
+		ugc_fiber_unlink(fiber);
+		ugc_fiber_push(&gc->dirty_fibers, fiber);
+#if UGC_USE_THREADS
+		ugc_unlock(&gc->heap_lock);
+#endif
+	}
+
+	fiber->state = UGC_FIBER_RUNNING;
+}
+
+void
+ugc_fiber_suspend(ugc_t* gc, ugc_fiber_t* fiber)
+{
+	(void)gc;
+	fiber->state = UGC_FIBER_DIRTY;
+}
+
+#endif
+
+#if UGC_USE_PINS
+
+void
+ugc_pins_init(ugc_t* gc, uintptr_t* slots, size_t capacity)
+{
+	gc->pin_slots = slots;
+	gc->pin_capacity = capacity;
+	gc->pin_size = 0;
+	gc->pin_free = 0;
+	gc->pin_cursor = 0;
+}
+
+size_t
+ugc_pin(ugc_t* gc, ugc_header_t* obj)
+{
+#if UGC_USE_THREADS
+	ugc_lock(&gc->heap_lock);
+#endif
+
+	size_t slot;
+	if(gc->pin_free != 0)
+	{
+		slot = gc->pin_free - 1;
+		gc->pin_free = (size_t)(gc->pin_slots[slot] >> 1);
+	}
+	else if(gc->pin_size < gc->pin_capacity)
+	{
+		slot = gc->pin_size++;
+	}
+	else
+	{
+		slot = SIZE_MAX;
+	}
+
+	if(slot != SIZE_MAX)
+	{
+		gc->pin_slots[slot] = (uintptr_t)obj;
+
+		// The slot may have been scanned already
+		if(gc->state == UGC_MARK && ugc_color(obj) == gc->white) { ugc_make_gray(gc, obj); }
+	}
+
+#if UGC_USE_THREADS
+	ugc_unlock(&gc->heap_lock);
+#endif
+
+	return slot;
+}
+
+void
+ugc_unpin(ugc_t* gc, size_t slot)
+{
+#if UGC_USE_THREADS
+	ugc_lock(&gc->heap_lock);
+#endif
+
+	gc->pin_slots[slot] = ((uintptr_t)gc->pin_free << 1) | 1;
+	gc->pin_free = slot + 1;
+
+#if UGC_USE_THREADS
+	ugc_unlock(&gc->heap_lock);
+#endif
+}
+
+ugc_header_t*
+ugc_pinned(ugc_t* gc, size_t slot)
+{
+	return (ugc_header_t*)gc->pin_slots[slot];
+}
+
+#endif
+
+#if UGC_USE_CONSERVATIVE
+
+#include <setjmp.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define UGC_NOINLINE __attribute__((noinline))
+#define UGC_SPILL_REGISTERS() __builtin_unwind_init()
+typedef uintptr_t __attribute__((may_alias)) ugc_word_t;
+#elif defined(_MSC_VER)
+#define UGC_NOINLINE __declspec(noinline)
+#define UGC_SPILL_REGISTERS()
+typedef uintptr_t ugc_word_t;
+#else
+#define UGC_NOINLINE
+#define UGC_SPILL_REGISTERS()
+typedef uintptr_t ugc_word_t;
+#endif
+
+#if defined(__SANITIZE_ADDRESS__)
+#define UGC_NO_SANITIZE_ADDRESS __attribute__((no_sanitize_address))
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define UGC_NO_SANITIZE_ADDRESS __attribute__((no_sanitize_address))
+#endif
+#endif
+
+#ifndef UGC_NO_SANITIZE_ADDRESS
+#define UGC_NO_SANITIZE_ADDRESS
+#endif
+
+static inline size_t
+ugc_index_slot(const ugc_index_t* index, uintptr_t key)
+{
+	return (size_t)(((uint64_t)key * 0x9e3779b97f4a7c15ull) >> index->shift);
+}
+
+static size_t
+ugc_index_lookup(const ugc_index_t* index, uintptr_t key, const ugc_header_t* obj)
+{
+	const ugc_index_entry_t* entries = index->entries;
+	for(size_t i = ugc_index_slot(index, key); entries[i].key != 0; i = (i + 1) & index->mask)
+	{
+		if(entries[i].key == key && entries[i].obj == obj) { return i; }
+	}
+
+	return index->mask + 1;
+}
+
+static void
+ugc_index_delete(ugc_index_t* index, size_t hole)
+{
+	// Backward shift deletion: entries after the hole move back unless that
+	// would put them before their home slot.
+	ugc_index_entry_t* entries = index->entries;
+	size_t mask = index->mask;
+	for(size_t i = (hole + 1) & mask; entries[i].key != 0; i = (i + 1) & mask)
+	{
+		size_t home = ugc_index_slot(index, entries[i].key);
+		if(((i - home) & mask) >= ((i - hole) & mask))
+		{
+			entries[hole] = entries[i];
+			hole = i;
+		}
+	}
+
+	entries[hole].key = 0;
+	--index->num_entries;
+}
+
+void
+ugc_index_init(ugc_index_t* index, ugc_index_entry_t* entries, size_t capacity)
+{
+	for(size_t i = 0; i < capacity; ++i) { entries[i].key = 0; }
+
+	unsigned int bits = 0;
+	while(((size_t)1 << bits) < capacity) { ++bits; }
+
+	index->entries = entries;
+	index->mask = capacity - 1;
+	index->shift = 64 - bits;
+	index->num_entries = 0;
+	index->min = UINTPTR_MAX;
+	index->max = 0;
+}
+
+int
+ugc_index_add(ugc_index_t* index, ugc_header_t* obj, size_t size)
+{
+	uintptr_t start = (uintptr_t)obj;
+	uintptr_t first = (start >> UGC_INDEX_GRANULE_SHIFT) + 1;
+	uintptr_t last = ((start + size - 1) >> UGC_INDEX_GRANULE_SHIFT) + 1;
+
+	size_t capacity = index->mask + 1;
+	if(index->num_entries + (last - first + 1) > capacity - capacity / 4) { return -1; }
+
+	for(uintptr_t key = first; key <= last; ++key)
+	{
+		size_t i = ugc_index_slot(index, key);
+		while(index->entries[i].key != 0) { i = (i + 1) & index->mask; }
+
+		index->entries[i] = (ugc_index_entry_t){ .key = key, .obj = obj, .size = size };
+	}
+
+	index->num_entries += last - first + 1;
+	if(start < index->min) { index->min = start; }
+	if(start + size > index->max) { index->max = start + size; }
+
+	return 0;
+}
 
-static inline void
-ugc_set_next(ugc_header_t* obj, ugc_header_t* value)
+void
+ugc_index_remove(ugc_index_t* index, ugc_header_t* obj)
 {
-	UGC_SET_PTR(obj->next, value);
+	uintptr_t key = ((uintptr_t)obj >> UGC_INDEX_GRANULE_SHIFT) + 1;
+	size_t i = ugc_index_lookup(index, key, obj);
+	if(i > index->mask) { return; }
+
+	uintptr_t last = (((uintptr_t)obj + index->entries[i].size - 1) >> UGC_INDEX_GRANULE_SHIFT) + 1;
+	for(;;)
+	{
+		ugc_index_delete(index, i);
+		if(key == last) { break; }
+
+		i = ugc_index_lookup(index, ++key, obj);
+	}
 }
 
-static inline ugc_header_t*
-ugc_next(ugc_header_t* obj)
+ugc_header_t*
+ugc_index_find(const ugc_index_t* index, const void* ptr)
 {
-	return (ugc_header_t*)UGC_PTR(obj->next);
+	uintptr_t addr = (uintptr_t)ptr;
+	if(addr < index->min || addr >= index->max) { return NULL; }
+
+	uintptr_t key = (addr >> UGC_INDEX_GRANULE_SHIFT) + 1;
+	const ugc_index_entry_t* entries = index->entries;
+	for(size_t i = ugc_index_slot(index, key); entries[i].key != 0; i = (i + 1) & index->mask)
+	{
+		uintptr_t start = (uintptr_t)entries[i].obj;
+		if(entries[i].key == key && addr >= start && addr - start < entries[i].size)
+		{
+			return entries[i].obj;
+		}
+	}
+
+	return NULL;
 }
 
-static inline void
-ugc_set_prev(ugc_header_t* obj, ugc_header_t* value)
+// Stack frames contain uninitialized words and redzones
+UGC_NO_SANITIZE_ADDRESS void
+ugc_scan_range(ugc_t* gc, const void* begin, const void* end)
 {
-	UGC_SET_PTR(obj->prev, value);
+	const ugc_index_t* index = gc->index;
+	if(index == NULL) { return; }
+
+	uintptr_t align = sizeof(ugc_word_t) - 1;
+	uintptr_t itr = ((uintptr_t)begin + align) & ~align;
+	uintptr_t min = index->min;
+	uintptr_t max = index->max;
+
+	for(; itr + sizeof(ugc_word_t) <= (uintptr_t)end; itr += sizeof(ugc_word_t))
+	{
+		uintptr_t word = *(const ugc_word_t*)itr;
+		if(word < min || word >= max) { continue; }
+
+		ugc_header_t* obj = ugc_index_find(index, (const void*)word);
+		if(obj != NULL) { ugc_visit(gc, obj); }
+	}
 }
 
-static inline ugc_header_t*
-ugc_prev(ugc_header_t* obj)
+static void
+ugc_scan_between(ugc_t* gc, const void* a, const void* b)
 {
-	return (ugc_header_t*)UGC_PTR(obj->prev);
+	// Stacks grow downward on most platforms but not all
+	if((uintptr_t)a < (uintptr_t)b)
+	{
+		ugc_scan_range(gc, a, b);
+	}
+	else
+	{
+		ugc_scan_range(gc, b, a);
+	}
 }
 
-static inline void
-ugc_set_color(ugc_header_t* obj, unsigned char color)
+static UGC_NOINLINE void
+ugc_scan_stack_from_here(ugc_t* gc, const void* stack_base)
 {
-	UGC_SET_TAG(obj->next, color);
+	// The frames of all callers are between this one and the base
+	volatile char marker = 0;
+	ugc_scan_between(gc, (const void*)&marker, stack_base);
 }
 
-static inline unsigned char
-ugc_color(ugc_header_t* obj)
+UGC_NOINLINE void
+ugc_scan_stack(ugc_t* gc, const void* stack_base)
 {
-	return (unsigned char)UGC_TAG(obj->next);
+	// Callee-saved registers may hold the only reference to an object. Both
+	// methods store them in this frame.
+	jmp_buf registers;
+	UGC_SPILL_REGISTERS();
+	setjmp(registers);
+
+	ugc_scan_stack_from_here(gc, stack_base);
+
+	// Keep this frame alive during the call above instead of a tail call
+	(void)*(volatile char*)&registers;
 }
 
-#else
+#endif
 
-static inline void
-ugc_set_next(ugc_header_t* obj, ugc_header_t* value)
+#if UGC_USE_THREADS
+
+void
+ugc_thread_attach(ugc_t* gc, ugc_thread_t* thread, ugc_thread_scan_fn_t scan_fn)
 {
-	obj->next = value;
+	thread->scan_fn = scan_fn;
+	thread->prev = NULL;
+	thread->gc = gc;
+#if UGC_USE_CONSERVATIVE
+	thread->stack_top = NULL;
+#endif
+	ugc_clear(&thread->local);
+	atomic_init(&thread->state, UGC_THREAD_PARKED);
+
+	ugc_lock(&gc->thread_lock);
+	thread->next = gc->threads;
+	if(gc->threads != NULL) { gc->threads->prev = thread; }
+	gc->threads = thread;
+	ugc_unlock(&gc->thread_lock);
+
+	ugc_thread_wait(gc, thread);
 }
 
-static inline ugc_header_t*
-ugc_next(ugc_header_t* obj)
+void
+ugc_thread_detach(ugc_t* gc, ugc_thread_t* thread)
 {
-	return obj->next;
+	// Park first so that a thread holding thread_lock in ugc_safepoint_begin
+	// does not wait for this thread.
+	atomic_store(&thread->state, UGC_THREAD_PARKED);
+
+	ugc_lock(&gc->thread_lock);
+	if(thread->prev != NULL) { thread->prev->next = thread->next; }
+	else { gc->threads = thread->next; }
+	if(thread->next != NULL) { thread->next->prev = thread->prev; }
+
+	ugc_lock(&gc->heap_lock);
+	ugc_flush_local(gc, thread);
+	ugc_unlock(&gc->heap_lock);
+	ugc_unlock(&gc->thread_lock);
 }
 
-static inline void
-ugc_set_prev(ugc_header_t* obj, ugc_header_t* value)
+void
+ugc_register_local(ugc_t* gc, ugc_thread_t* thread, ugc_header_t* obj)
 {
-	obj->prev = value;
+	// During the mark phase, a local object can be reached by a barrier on
+	// another thread before it is flushed. Making it gray keeps barriers away
+	// from the local list. It will survive the current cycle.
+#if UGC_USE_RECORD
+	ugc_record(gc, UGC_RECORD_REGISTER, obj, NULL);
+#endif
+	ugc_push(&thread->local, obj);
+	ugc_set_color(obj, gc->state == UGC_MARK ? UGC_GRAY : gc->white);
 }
 
-static inline ugc_header_t*
-ugc_prev(ugc_header_t* obj)
+#if UGC_USE_CONSERVATIVE
+
+static UGC_NOINLINE void
+ugc_park_here(ugc_t* gc, ugc_thread_t* thread)
 {
-	return obj->prev;
+	volatile char marker = 0;
+	thread->stack_top = (const void*)&marker;
+	atomic_store(&thread->state, UGC_THREAD_PARKED);
+	ugc_thread_wait(gc, thread);
 }
 
-static inline void
-ugc_set_color(ugc_header_t* obj, unsigned char color)
+static UGC_NOINLINE void
+ugc_park(ugc_t* gc, ugc_thread_t* thread)
 {
-	obj->color = color;
+	// Same as ugc_scan_stack, the thread waits in a deeper frame so that this
+	// one is scanned by ugc_scan_thread
+	jmp_buf registers;
+	UGC_SPILL_REGISTERS();
+	setjmp(registers);
+
+	ugc_park_here(gc, thread);
+
+	thread->stack_top = NULL;
+	(void)*(volatile char*)&registers;
 }
 
-static unsigned char
-ugc_color(ugc_header_t* obj)
+#endif
+
+void
+ugc_safepoint(ugc_t* gc, ugc_thread_t* thread)
 {
-	return obj->color;
+	if(atomic_load_explicit(&gc->safepoint, memory_order_relaxed))
+	{
+#if UGC_USE_CONSERVATIVE
+		ugc_park(gc, thread);
+#else
+		atomic_store(&thread->state, UGC_THREAD_PARKED);
+		ugc_thread_wait(gc, thread);
+#endif
+	}
 }
 
+#if UGC_USE_CONSERVATIVE && UGC_BLOCK_STUB
+
+#if defined(__APPLE__)
+#define UGC_ASM_SYMBOL(name) "_" name
+#define UGC_ASM_BEGIN ".text\n"
+#define UGC_ASM_FUNCTION(name) ".globl _" name "\n_" name ":\n"
+#define UGC_ASM_END
+#else
+#define UGC_ASM_SYMBOL(name) name
+#define UGC_ASM_BEGIN ".pushsection .text\n"
+#define UGC_ASM_FUNCTION(name) ".globl " name "\n.type " name ", %function\n" name ":\n"
+#define UGC_ASM_END ".popsection\n"
 #endif
 
-static void
-ugc_push(ugc_header_t* list, ugc_header_t* element)
+// Called by ugc_thread_block with the registers it pushed. Compiled code
+// might have modified them before they could be read.
+__attribute__((used, visibility("hidden"))) void
+ugc_thread_blocked(ugc_t* gc, ugc_thread_t* thread, const void* stack_top, const uintptr_t* registers);
+
+void
+ugc_thread_blocked(ugc_t* gc, ugc_thread_t* thread, const void* stack_top, const uintptr_t* registers)
 {
-	ugc_set_next(element, list);
-	ugc_set_prev(element, list->prev);
-	ugc_set_next(list->prev, element);
-	ugc_set_prev(list, element);
+	(void)gc;
+
+	for(size_t i = 0; i < UGC_BLOCK_NUM_REGISTERS; ++i) { thread->registers[i] = registers[i]; }
+
+	// The caller's frame is above the stack pointer it had before the call
+	thread->stack_top = stack_top;
+	atomic_store(&thread->state, UGC_THREAD_PARKED);
 }
 
-static void
-ugc_unlink(ugc_header_t* element)
+#if defined(__x86_64__)
+
+#if defined(__CET__) && (__CET__ & 1)
+#define UGC_ASM_LANDING "\tendbr64\n"
+#else
+#define UGC_ASM_LANDING
+#endif
+
+// rbx, rbp and r12-r15, below a padding word which keeps the stack aligned
+__asm__(
+	UGC_ASM_BEGIN
+	".p2align 4\n"
+	UGC_ASM_FUNCTION("ugc_thread_block")
+	UGC_ASM_LANDING
+	"\tleaq 8(%rsp), %rdx\n"
+	"\tsubq $8, %rsp\n"
+	"\tpushq %r15\n"
+	"\tpushq %r14\n"
+	"\tpushq %r13\n"
+	"\tpushq %r12\n"
+	"\tpushq %rbp\n"
+	"\tpushq %rbx\n"
+	"\tmovq %rsp, %rcx\n"
+	"\tcall " UGC_ASM_SYMBOL("ugc_thread_blocked") "\n"
+	"\taddq $56, %rsp\n"
+	"\tret\n"
+	UGC_ASM_END
+);
+
+#elif defined(__aarch64__)
+
+#if defined(__ARM_FEATURE_BTI_DEFAULT)
+#define UGC_ASM_LANDING "\thint #34\n"
+#else
+#define UGC_ASM_LANDING
+#endif
+
+// x19-x30
+__asm__(
+	UGC_ASM_BEGIN
+	".p2align 2\n"
+	UGC_ASM_FUNCTION("ugc_thread_block")
+	UGC_ASM_LANDING
+	"\tmov x2, sp\n"
+	"\tstp x29, x30, [sp, #-96]!\n"
+	"\tstp x19, x20, [sp, #16]\n"
+	"\tstp x21, x22, [sp, #32]\n"
+	"\tstp x23, x24, [sp, #48]\n"
+	"\tstp x25, x26, [sp, #64]\n"
+	"\tstp x27, x28, [sp, #80]\n"
+	"\tmov x3, sp\n"
+	"\tbl " UGC_ASM_SYMBOL("ugc_thread_blocked") "\n"
+	"\tldp x29, x30, [sp], #96\n"
+	"\tret\n"
+	UGC_ASM_END
+);
+
+#endif
+
+#else
+
+void
+ugc_thread_block(ugc_t* gc, ugc_thread_t* thread)
 {
-	ugc_header_t* next = ugc_next(element);
-	ugc_header_t* prev = ugc_prev(element);
+	(void)gc;
 
-	ugc_set_prev(next, prev);
-	ugc_set_next(prev, next);
+#if UGC_USE_CONSERVATIVE
+	// The caller's frame is above this one
+	volatile char marker = 0;
+	setjmp(thread->registers);
+	thread->stack_top = (const void*)&marker;
+#endif
+
+	atomic_store(&thread->state, UGC_THREAD_PARKED);
 }
 
-static void
-ugc_make_gray(ugc_t* gc, ugc_header_t* obj)
-{
-	// Move iterator back before moving obj
-	if(obj == gc->iterator) { gc->iterator = ugc_prev(obj); }
+#endif
 
-	ugc_unlink(obj);
-	ugc_push(gc->to, obj);
-	ugc_set_color(obj, UGC_GRAY);
+#if UGC_USE_CONSERVATIVE
+
+void
+ugc_scan_thread(ugc_t* gc, ugc_thread_t* thread)
+{
+	if(atomic_load(&thread->state) == UGC_THREAD_RUNNING)
+	{
+		// Other threads are stopped during a collection
+		ugc_scan_stack(gc, thread->stack_base);
+	}
+	else if(thread->stack_top != NULL)
+	{
+		ugc_scan_range(gc, &thread->registers, (const char*)&thread->registers + sizeof(jmp_buf));
+		ugc_scan_between(gc, thread->stack_top, thread->stack_base);
+	}
 }
 
-static void
-ugc_clear(ugc_header_t* list)
+#endif
+
+void
+ugc_thread_unblock(ugc_t* gc, ugc_thread_t* thread)
 {
-	list->next = list;
-	list->prev = list;
+	ugc_thread_wait(gc, thread);
 }
 
-static void
-ugc_release_set(ugc_t* gc, ugc_header_t* set)
+void
+ugc_safepoint_begin(ugc_t* gc, ugc_thread_t* self)
 {
-	for(ugc_header_t* itr = ugc_next(set); itr != set;)
+	// Another thread might be collecting, take part in its safepoint while
+	// waiting for our turn.
+	while(atomic_flag_test_and_set_explicit(&gc->thread_lock, memory_order_acquire))
 	{
-		ugc_header_t* next = ugc_next(itr);
+		if(self != NULL) { ugc_safepoint(gc, self); }
+		UGC_YIELD();
+	}
 
-		gc->release_fn(gc, itr);
+	atomic_store(&gc->safepoint, 1);
 
-		itr = next;
+	for(ugc_thread_t* itr = gc->threads; itr != NULL; itr = itr->next)
+	{
+		if(itr == self) { continue; }
+
+		while(atomic_load(&itr->state) != UGC_THREAD_PARKED) { UGC_YIELD(); }
 	}
 }
 
 void
-ugc_init(ugc_t* gc, ugc_visit_fn_t scan_fn, ugc_visit_fn_t release_fn)
+ugc_safepoint_end(ugc_t* gc)
 {
-	ugc_clear(&gc->set1);
-	ugc_clear(&gc->set2);
+	atomic_store(&gc->safepoint, 0);
+	ugc_unlock(&gc->thread_lock);
+}
 
-	gc->state = UGC_IDLE;
-	gc->scan_fn = scan_fn;
-	gc->release_fn = release_fn;
-	gc->white = 0;
-	gc->from = &gc->set1;
-	gc->to = &gc->set2;
-	gc->iterator = gc->to;
-	gc->userdata = NULL;
+void
+ugc_handle_set(ugc_t* gc, ugc_handle_t* handle, ugc_header_t* obj)
+{
+	ugc_lock(&gc->heap_lock);
+	handle->target = obj;
+	handle->next = &gc->handles;
+	handle->prev = gc->handles.prev;
+	gc->handles.prev->next = handle;
+	gc->handles.prev = handle;
+	ugc_unlock(&gc->heap_lock);
 }
 
 void
-ugc_register(ugc_t* gc, ugc_header_t* obj)
+ugc_handle_clear(ugc_t* gc, ugc_handle_t* handle)
 {
-	ugc_push(gc->from, obj);
-	ugc_set_color(obj, gc->white);
+	ugc_lock(&gc->heap_lock);
+	handle->next->prev = handle->prev;
+	handle->prev->next = handle->next;
+	handle->target = NULL;
+	ugc_unlock(&gc->heap_lock);
 }
 
 void
-ugc_release_all(ugc_t* gc)
+ugc_group_init(ugc_group_t* group, ugc_t** heaps, size_t num_heaps)
 {
-	ugc_release_set(gc, gc->from);
-	ugc_release_set(gc, gc->to);
+	group->heaps = heaps;
+	atomic_init(&group->cursor, 0);
+	ugc_group_reset(group, num_heaps);
 }
 
 void
-ugc_write_barrier(
-	ugc_t* gc,
-	enum ugc_barrier_direction_e direction,
-	ugc_header_t* parent,
-	ugc_header_t* child
-)
+ugc_group_reset(ugc_group_t* group, size_t num_heaps)
 {
-	unsigned char white = gc->white;
-	unsigned char black = !gc->white;
+	group->num_heaps = num_heaps;
+	atomic_store(&group->cursor, 0);
+}
 
-	if(ugc_color(parent) == black && ugc_color(child) == white)
+static size_t
+ugc_group_run(ugc_group_t* group, ugc_thread_t* self, int collect)
+{
+	size_t num_stepped = 0;
+
+	// Otherwise, the calling thread would wait for itself to reach a
+	// safepoint when it claims its own GC
+	if(self != NULL) { ugc_thread_block(self->gc, self); }
+
+	for(;;)
 	{
-		switch(direction)
+		size_t index = atomic_fetch_add(&group->cursor, 1);
+		if(index >= group->num_heaps) { break; }
+
+		ugc_t* gc = group->heaps[index];
+		ugc_safepoint_begin(gc, NULL);
+
+		if(collect)
 		{
-			case UGC_BARRIER_FORWARD:
-				ugc_make_gray(gc, child);
-				break;
-			case UGC_BARRIER_BACKWARD:
-				ugc_make_gray(gc, parent);
-				break;
+			ugc_collect(gc);
 		}
+		else
+		{
+			for(unsigned int i = 0; i < gc->budget; ++i) { ugc_step(gc); }
+		}
+
+		ugc_safepoint_end(gc);
+		++num_stepped;
 	}
+
+	if(self != NULL) { ugc_thread_unblock(self->gc, self); }
+
+	return num_stepped;
+}
+
+size_t
+ugc_group_step(ugc_group_t* group, ugc_thread_t* self)
+{
+	return ugc_group_run(group, self, 0);
 }
 
+size_t
+ugc_group_collect(ugc_group_t* group, ugc_thread_t* self)
+{
+	return ugc_group_run(group, self, 1);
+}
+
+#endif
+
+#if UGC_USE_EPOCHS
+
 void
-ugc_visit(ugc_t* gc, ugc_header_t* obj)
+ugc_reader_attach(ugc_t* gc, ugc_reader_t* reader)
 {
-	if(ugc_color(obj) == gc->white)
-	{
-		ugc_make_gray(gc, obj);
-	}
+	atomic_init(&reader->epoch, 0);
+
+	ugc_lock(&gc->heap_lock);
+	reader->next = &gc->readers;
+	reader->prev = gc->readers.prev;
+	gc->readers.prev->next = reader;
+	gc->readers.prev = reader;
+	atomic_fetch_add(&gc->num_readers, 1);
+	ugc_unlock(&gc->heap_lock);
 }
 
 void
-ugc_step(ugc_t* gc)
+ugc_reader_detach(ugc_t* gc, ugc_reader_t* reader)
 {
-	ugc_header_t* obj;
-	ugc_header_t* to = gc->to;
+	ugc_lock(&gc->heap_lock);
+	reader->prev->next = reader->next;
+	reader->next->prev = reader->prev;
+	atomic_fetch_sub(&gc->num_readers, 1);
+	ugc_unlock(&gc->heap_lock);
+}
 
-	switch((enum ugc_state_e)gc->state)
-	{
-		case UGC_IDLE:
-			gc->scan_fn(gc, NULL);
-			gc->state = UGC_MARK;
-			break;
-		case UGC_MARK:
-			{
-				obj = ugc_next(gc->iterator);
-				unsigned char white = gc->white;
+void
+ugc_read_begin(ugc_t* gc, ugc_reader_t* reader)
+{
+	atomic_store(&reader->epoch, atomic_load(&gc->epoch));
+	// Reads of the section must not be performed before the epoch is visible
+	atomic_thread_fence(memory_order_seq_cst);
+}
 
-				if(obj != to)
-				{
-					gc->iterator = obj;
-					ugc_set_color(obj, !white);
-					gc->scan_fn(gc, obj);
-				}
-				else
-				{
-					gc->scan_fn(gc, NULL);
-					obj = ugc_next(gc->iterator);
-					if(obj == to)
-					{
-						// Since we can get interrupted during the sweep phase,
-						// swap "from" and "to" set, flip white color before
-						// starting the sweep phase.
-						ugc_header_t* from = gc->from;
-						gc->from = to;
-						gc->to = from;
-						gc->white = !white;
-						gc->iterator = from->next;
-						gc->state = UGC_SWEEP;
-					}
-				}
-			}
-			break;
-		case UGC_SWEEP:
-			obj = gc->iterator;
-			if(obj != to)
-			{
-				gc->iterator = ugc_next(obj);
-				gc->release_fn(gc, obj);
-			}
-			else
-			{
-				ugc_clear(to);
-				gc->state = UGC_IDLE;
-			}
-			break;
-	}
+void
+ugc_read_end(ugc_reader_t* reader)
+{
+	atomic_store_explicit(&reader->epoch, 0, memory_order_release);
 }
 
 void
-ugc_collect(ugc_t* gc)
+ugc_reclaim(ugc_t* gc)
 {
-	if(gc->state == UGC_IDLE) { ugc_step(gc); }
-	while(gc->state != UGC_IDLE) { ugc_step(gc); }
+	// Everything is released at once if no reader is in a read section
+	if(ugc_advance_epoch(gc)) { ugc_advance_epoch(gc); }
 }
 
 #endif
 
 #endif
+
+#endif
@@ -0,0 +1,657 @@
+#ifndef UGC_HPP
+#define UGC_HPP
+
+/**
+ * @file
+ * @brief Compile-time specialized collector for C++ hosts.
+ *
+ * ugc::heap implements the same algorithm as ugc.h but takes its callbacks
+ * from a traits class instead of function pointers. The compiler can then
+ * inline scanning and releasing into the mark and sweep loops, along with
+ * ugc::heap::visit and the write barrier.
+ *
+ * Objects embed a ugc_header_t just like with the C API. A heap and a ugc_t
+ * MUST NOT share objects.
+ *
+ * Only the core API is provided: none of the UGC_USE_* options apply except
+ * UGC_USE_TAGGED_POINTER.
+ *
+ * ugc::field and ugc::array hold references in managed objects and issue the
+ * write barrier on every store. They work with both ugc::heap and ugc_t.
+ *
+ * UGC_USE_THREADS is not supported: the declarations of ugc.h then rely on
+ * the atomic types of C11 which C++ does not provide.
+ */
+
+#if defined(UGC_USE_THREADS) && UGC_USE_THREADS
+#error "ugc.hpp does not support UGC_USE_THREADS"
+#endif
+
+// The C API is used by ugc::field and ugc::array on a ugc_t
+#ifndef UGC_DECL
+#define UGC_DECL extern "C"
+#endif
+
+#include "ugc.h"
+
+#include <stdint.h>
+
+namespace ugc
+{
+
+namespace detail
+{
+
+const unsigned char gray = 2;
+
+#if UGC_USE_TAGGED_POINTER
+
+inline ugc_header_t*
+untag(ugc_header_t* ptr)
+{
+	return reinterpret_cast<ugc_header_t*>(reinterpret_cast<uintptr_t>(ptr) & ~uintptr_t(0x03));
+}
+
+inline ugc_header_t*
+next(ugc_header_t* obj)
+{
+	return untag(obj->next);
+}
+
+inline void
+set_next(ugc_header_t* obj, ugc_header_t* value)
+{
+	uintptr_t tag = reinterpret_cast<uintptr_t>(obj->next) & 0x03;
+	obj->next = reinterpret_cast<ugc_header_t*>(reinterpret_cast<uintptr_t>(value) | tag);
+}
+
+inline ugc_header_t*
+prev(ugc_header_t* obj)
+{
+	return untag(obj->prev);
+}
+
+inline void
+set_prev(ugc_header_t* obj, ugc_header_t* value)
+{
+	uintptr_t tag = reinterpret_cast<uintptr_t>(obj->prev) & 0x03;
+	obj->prev = reinterpret_cast<ugc_header_t*>(reinterpret_cast<uintptr_t>(value) | tag);
+}
+
+inline unsigned char
+color(const ugc_header_t* obj)
+{
+	return static_cast<unsigned char>(reinterpret_cast<uintptr_t>(obj->next) & 0x03);
+}
+
+inline void
+set_color(ugc_header_t* obj, unsigned char color)
+{
+	obj->next = reinterpret_cast<ugc_header_t*>(
+		reinterpret_cast<uintptr_t>(untag(obj->next)) | color
+	);
+}
+
+#else
+
+inline ugc_header_t*
+next(ugc_header_t* obj)
+{
+	return obj->next;
+}
+
+inline void
+set_next(ugc_header_t* obj, ugc_header_t* value)
+{
+	obj->next = value;
+}
+
+inline ugc_header_t*
+prev(ugc_header_t* obj)
+{
+	return obj->prev;
+}
+
+inline void
+set_prev(ugc_header_t* obj, ugc_header_t* value)
+{
+	obj->prev = value;
+}
+
+inline unsigned char
+color(const ugc_header_t* obj)
+{
+	return static_cast<unsigned char>(obj->color);
+}
+
+inline void
+set_color(ugc_header_t* obj, unsigned char color)
+{
+	obj->color = color;
+}
+
+#endif
+
+inline void
+clear(ugc_header_t* list)
+{
+	list->next = list;
+	list->prev = list;
+}
+
+inline void
+push(ugc_header_t* list, ugc_header_t* element)
+{
+	set_next(element, list);
+	set_prev(element, prev(list));
+	set_next(prev(list), element);
+	set_prev(list, element);
+}
+
+inline void
+unlink(ugc_header_t* element)
+{
+	ugc_header_t* before = prev(element);
+	ugc_header_t* after = next(element);
+	set_next(before, after);
+	set_prev(after, before);
+}
+
+}
+
+/**
+ * @brief Garbage collected heap.
+ *
+ * `Traits` MUST provide the following members, which replace the callbacks of
+ * ugc_init:
+ *
+ * @code
+ * struct traits
+ * {
+ *     // Call heap.visit on all root objects
+ *     void scan_roots(ugc::heap<traits>& heap);
+ *     // Call heap.visit on all objects referenced by obj
+ *     void scan(ugc::heap<traits>& heap, ugc_header_t* obj);
+ *     // obj has become garbage
+ *     void release(ugc::heap<traits>& heap, ugc_header_t* obj);
+ * };
+ * @endcode
+ *
+ * Type dispatch (e.g: a switch over a type tag) belongs in `scan` and
+ * `release` where it is inlined as well.
+ *
+ * The destructor releases all objects.
+ */
+template<typename Traits>
+class heap
+{
+public:
+	explicit heap(const Traits& traits = Traits())
+		:from_(&set1_)
+		,to_(&set2_)
+		,iterator_(&set2_)
+		,state_(UGC_IDLE)
+		,white_(0)
+		,traits_(traits)
+	{
+		detail::clear(&set1_);
+		detail::clear(&set2_);
+	}
+
+	~heap()
+	{
+		release_all();
+	}
+
+	/// The traits instance passed to the constructor.
+	Traits&
+	traits()
+	{
+		return traits_;
+	}
+
+	/// Current state of the garbage collection.
+	ugc_state_e
+	state() const
+	{
+		return static_cast<ugc_state_e>(state_);
+	}
+
+	/// Color of white objects, to be compared with ugc::heap::color.
+	unsigned char
+	white() const
+	{
+		return white_;
+	}
+
+	/// @see ugc_color
+	static unsigned char
+	color(const ugc_header_t* obj)
+	{
+		return detail::color(obj);
+	}
+
+	/// @see ugc_register
+	void
+	add(ugc_header_t* obj)
+	{
+		detail::push(from_, obj);
+		detail::set_color(obj, white_);
+	}
+
+	/// @see ugc_visit
+	void
+	visit(ugc_header_t* obj)
+	{
+		if(detail::color(obj) == white_) { make_gray(obj); }
+	}
+
+	/**
+	 * @brief Write barrier with a direction chosen at compile time.
+	 * @see ugc_write_barrier
+	 */
+	template<ugc_barrier_direction_e Direction>
+	void
+	write_barrier(ugc_header_t* parent, ugc_header_t* child)
+	{
+		// Black is never equal to white, so this is only true while marking
+		if(detail::color(parent) == !white_ && detail::color(child) == white_)
+		{
+			make_gray(Direction == UGC_BARRIER_FORWARD ? child : parent);
+		}
+	}
+
+	/// @see ugc_write_barrier
+	void
+	write_barrier(ugc_barrier_direction_e direction, ugc_header_t* parent, ugc_header_t* child)
+	{
+		if(direction == UGC_BARRIER_FORWARD)
+		{
+			write_barrier<UGC_BARRIER_FORWARD>(parent, child);
+		}
+		else
+		{
+			write_barrier<UGC_BARRIER_BACKWARD>(parent, child);
+		}
+	}
+
+	/// @see ugc_step
+	void
+	step()
+	{
+		switch(state_)
+		{
+			case UGC_IDLE:
+				traits_.scan_roots(*this);
+				state_ = UGC_MARK;
+				break;
+			case UGC_MARK:
+				{
+					ugc_header_t* obj = detail::next(iterator_);
+					if(obj != to_)
+					{
+						iterator_ = obj;
+						detail::set_color(obj, !white_);
+						traits_.scan(*this, obj);
+					}
+					else
+					{
+						traits_.scan_roots(*this);
+						if(detail::next(iterator_) == to_) { finish_mark(); }
+					}
+				}
+				break;
+			case UGC_SWEEP:
+				{
+					ugc_header_t* obj = iterator_;
+					if(obj != to_)
+					{
+						iterator_ = detail::next(obj);
+						traits_.release(*this, obj);
+					}
+					else
+					{
+						detail::clear(to_);
+						state_ = UGC_IDLE;
+					}
+				}
+				break;
+		}
+	}
+
+	/// @see ugc_collect
+	void
+	collect()
+	{
+		if(state_ == UGC_IDLE) { step(); }
+		while(state_ != UGC_IDLE) { step(); }
+	}
+
+	/// @see ugc_collect_full
+	void
+	collect_full()
+	{
+		while(state_ == UGC_SWEEP) { step(); }
+
+		if(state_ == UGC_MARK)
+		{
+			for(ugc_header_t* itr = detail::next(to_); itr != to_; itr = detail::next(itr))
+			{
+				detail::set_color(itr, white_);
+			}
+
+			splice(from_, to_);
+			iterator_ = to_;
+			state_ = UGC_IDLE;
+		}
+
+		state_ = UGC_MARK;
+		traits_.scan_roots(*this);
+
+		unsigned char black = !white_;
+		for(ugc_header_t* obj = detail::next(to_); obj != to_; obj = detail::next(obj))
+		{
+			iterator_ = obj;
+			detail::set_color(obj, black);
+			traits_.scan(*this, obj);
+		}
+
+		finish_mark();
+		release_set(detail::next(to_), to_);
+		detail::clear(to_);
+		iterator_ = to_;
+		state_ = UGC_IDLE;
+	}
+
+	/// @see ugc_release_all
+	void
+	release_all()
+	{
+		release_set(detail::next(from_), from_);
+		release_set(state_ == UGC_SWEEP ? iterator_ : detail::next(to_), to_);
+
+		detail::clear(from_);
+		detail::clear(to_);
+		iterator_ = to_;
+		state_ = UGC_IDLE;
+	}
+
+private:
+	heap(const heap&);
+	heap& operator=(const heap&);
+
+	void
+	make_gray(ugc_header_t* obj)
+	{
+		if(obj == iterator_) { iterator_ = detail::prev(obj); }
+
+		detail::unlink(obj);
+		detail::push(to_, obj);
+		detail::set_color(obj, detail::gray);
+	}
+
+	static void
+	splice(ugc_header_t* list, ugc_header_t* chain)
+	{
+		ugc_header_t* first = detail::next(chain);
+		if(first == chain) { return; }
+
+		ugc_header_t* last = detail::prev(chain);
+		ugc_header_t* tail = detail::prev(list);
+		detail::set_next(tail, first);
+		detail::set_prev(first, tail);
+		detail::set_next(last, list);
+		detail::set_prev(list, last);
+		detail::clear(chain);
+	}
+
+	void
+	finish_mark()
+	{
+		ugc_header_t* from = from_;
+		from_ = to_;
+		to_ = from;
+		white_ = !white_;
+		iterator_ = detail::next(from);
+		state_ = UGC_SWEEP;
+	}
+
+	void
+	release_set(ugc_header_t* first, ugc_header_t* set)
+	{
+		for(ugc_header_t* itr = first; itr != set;)
+		{
+			ugc_header_t* next = detail::next(itr);
+			traits_.release(*this, itr);
+			itr = next;
+		}
+	}
+
+	ugc_header_t set1_, set2_;
+	ugc_header_t *from_, *to_, *iterator_;
+	unsigned char state_;
+	unsigned char white_;
+	Traits traits_;
+};
+
+/**
+ * @brief Return the header of a managed object.
+ *
+ * Overload this for types whose header is not a member named `header`.
+ */
+template<typename T>
+inline ugc_header_t*
+header_of(T* obj)
+{
+	return &obj->header;
+}
+
+inline ugc_header_t*
+header_of(ugc_header_t* obj)
+{
+	return obj;
+}
+
+/// @see ugc::heap::visit
+template<typename Traits>
+inline void
+visit(heap<Traits>& heap, ugc_header_t* obj)
+{
+	heap.visit(obj);
+}
+
+/// @see ugc_visit
+inline void
+visit(ugc_t& gc, ugc_header_t* obj)
+{
+	ugc_visit(&gc, obj);
+}
+
+/// @see ugc::heap::write_barrier
+template<ugc_barrier_direction_e Direction, typename Traits>
+inline void
+write_barrier(heap<Traits>& heap, ugc_header_t* parent, ugc_header_t* child)
+{
+	heap.template write_barrier<Direction>(parent, child);
+}
+
+/**
+ * @brief Write barrier on a ugc_t with an inline fast path.
+ *
+ * ugc_write_barrier is only called when `parent` is black, unless
+ * UGC_USE_RECORD or UGC_USE_REGIONS is defined.
+ */
+template<ugc_barrier_direction_e Direction>
+inline void
+write_barrier(ugc_t& gc, ugc_header_t* parent, ugc_header_t* child)
+{
+#if !UGC_USE_RECORD && !UGC_USE_REGIONS
+	// Same test as ugc_write_barrier. Every barrier is recorded and escapes
+	// from a region are counted.
+	if(detail::color(parent) != !gc.white) { return; }
+#endif
+
+	ugc_write_barrier(&gc, Direction, parent, child);
+}
+
+/**
+ * @brief Reference to a managed object, stored in a managed object.
+ *
+ * Stores go through ugc::field::set which issues a write barrier. By default,
+ * it is a forward barrier: the new child is shaded. This costs one object per
+ * store into a black object but it is never rescanned.
+ *
+ * @tparam T Type of the referenced object.
+ * @tparam Direction Direction of the write barrier.
+ */
+template<typename T, ugc_barrier_direction_e Direction = UGC_BARRIER_FORWARD>
+class field
+{
+public:
+	field()
+		:ptr_(NULL)
+	{}
+
+	/// Initial value, only valid before the owner is registered.
+	explicit field(T* ptr)
+		:ptr_(ptr)
+	{}
+
+	T*
+	get() const
+	{
+		return ptr_;
+	}
+
+	T*
+	operator->() const
+	{
+		return ptr_;
+	}
+
+	operator T*() const
+	{
+		return ptr_;
+	}
+
+	/**
+	 * @brief Store a new reference.
+	 *
+	 * @param heap A ugc::heap or a ugc_t.
+	 * @param owner Object containing this field.
+	 * @param ptr New value, can be NULL.
+	 */
+	template<typename Heap, typename Owner>
+	void
+	set(Heap& heap, Owner* owner, T* ptr)
+	{
+		ptr_ = ptr;
+		if(ptr != NULL) { write_barrier<Direction>(heap, header_of(owner), header_of(ptr)); }
+	}
+
+	/// Visit the referenced object, to be called from the scan callback.
+	template<typename Heap>
+	void
+	visit(Heap& heap) const
+	{
+		if(ptr_ != NULL) { ugc::visit(heap, header_of(ptr_)); }
+	}
+
+private:
+	// Copying into another object would skip the barrier
+	field(const field&);
+	field& operator=(const field&);
+
+	T* ptr_;
+};
+
+/**
+ * @brief Array of references to managed objects, stored in a managed object.
+ *
+ * The storage is owned by the caller (e.g: a flexible array member of the
+ * owner). Stores go through ugc::array::set which issues a write barrier. By
+ * default, it is a backward barrier: the owner is grayed again. Once it is
+ * gray, further stores into it cost nothing until it is rescanned, which
+ * suits containers receiving many stores.
+ *
+ * @tparam T Type of the referenced objects.
+ * @tparam Direction Direction of the write barrier.
+ */
+template<typename T, ugc_barrier_direction_e Direction = UGC_BARRIER_BACKWARD>
+class array
+{
+public:
+	array()
+		:items_(NULL)
+		,size_(0)
+	{}
+
+	/**
+	 * @brief Wrap existing storage.
+	 *
+	 * Items are not initialized. The storage must not be written to directly
+	 * once the owner is registered.
+	 */
+	array(T** items, size_t size)
+		:items_(items)
+		,size_(size)
+	{}
+
+	/// Wrap other storage, only valid before the owner is registered.
+	void
+	reset(T** items, size_t size)
+	{
+		items_ = items;
+		size_ = size;
+	}
+
+	size_t
+	size() const
+	{
+		return size_;
+	}
+
+	T*
+	operator[](size_t index) const
+	{
+		return items_[index];
+	}
+
+	/**
+	 * @brief Store a new reference.
+	 *
+	 * @param heap A ugc::heap or a ugc_t.
+	 * @param owner Object containing this array.
+	 * @param index Index of the item, must be lower than ugc::array::size.
+	 * @param ptr New value, can be NULL.
+	 */
+	template<typename Heap, typename Owner>
+	void
+	set(Heap& heap, Owner* owner, size_t index, T* ptr)
+	{
+		items_[index] = ptr;
+		if(ptr != NULL) { write_barrier<Direction>(heap, header_of(owner), header_of(ptr)); }
+	}
+
+	/// Visit all referenced objects, to be called from the scan callback.
+	template<typename Heap>
+	void
+	visit(Heap& heap) const
+	{
+		for(size_t i = 0; i < size_; ++i)
+		{
+			if(items_[i] != NULL) { ugc::visit(heap, header_of(items_[i])); }
+		}
+	}
+
+private:
+	array(const array&);
+	array& operator=(const array&);
+
+	T** items_;
+	size_t size_;
+};
+
+}
+
+#endif